@@ -410,6 +410,13 @@ public:
             remove(out, len) : len;
     }
 
+    // позиция первого вхождения what, -1 если нет
+    ev_ssize_t search(const char *what, std::size_t len) const noexcept
+    {
+        assert(what && len);
+        return evbuffer_search(assert_handle(), what, len, nullptr).pos;
+    }
+
     int peek(net::iov* vec_out, int n_vec) noexcept
     {
         return evbuffer_peek(assert_handle(), -1, nullptr, vec_out, n_vec);
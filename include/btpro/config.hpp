@@ -23,6 +23,10 @@ private:
     std::unique_ptr<event_config, decltype(&event_config_free)>
         hconf_{create(), event_config_free};
 
+    // io_uring реактор (uring::reactor), 0 - не используется
+    unsigned uring_entries_{};
+    unsigned uring_flags_{};
+
 public:
     config() = default;
 
@@ -52,6 +56,24 @@ public:
             event_config_set_flag(handle(), flag));
     }
 
+    // размер колец и флаги IORING_SETUP_* для uring::reactor
+    // сама очередь libevent продолжает работать через epoll
+    void set_uring(unsigned entries, unsigned flags = 0) noexcept
+    {
+        uring_entries_ = entries;
+        uring_flags_ = flags;
+    }
+
+    unsigned uring_entries() const noexcept
+    {
+        return uring_entries_;
+    }
+
+    unsigned uring_flags() const noexcept
+    {
+        return uring_flags_;
+    }
+
     static inline std::vector<std::string> supported_methods()
     {
         std::vector<std::string> res;
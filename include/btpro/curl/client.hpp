@@ -1,10 +1,16 @@
 #pragma once
 
 #include "btpro/curl/request.hpp"
+#include "btpro/curl/telemetry.hpp"
 #include "btpro/evcore.hpp"
 #include "btpro/queue.hpp"
 
 #include <vector>
+#include <string>
+#include <unordered_map>
+#include <array>
+#include <chrono>
+#include <random>
 #include <type_traits>
 #include <algorithm>
 
@@ -54,6 +60,81 @@ public:
     using handle_t = multi_handle_t;
     using error_fn_type = std::function<void(std::string_view)>;
 
+    using clock = std::chrono::steady_clock;
+
+    // класс приоритета в очереди допуска, high уходит первым
+    enum class priority
+        : std::uint8_t
+    {
+        high = 0,
+        normal,
+        low
+    };
+
+    constexpr static std::size_t priority_count = 3;
+
+    // расписание запроса
+    struct policy
+    {
+        // срок на все попытки от момента запуска, 0 - без срока
+        // остаток срока выставляется в CURLOPT_TIMEOUT_MS каждой попытки
+        std::chrono::milliseconds deadline{};
+        // число повторов после первой попытки
+        unsigned retries{};
+        // задержка перед повтором n - случайная в [0, backoff * 2^n]
+        // но не больше backoff_max
+        std::chrono::milliseconds backoff{50};
+        std::chrono::milliseconds backoff_max{2000};
+        // дублирующий запрос если ответа нет за hedge_after
+        // ответ берется от первого успешного, второй отменяется
+        bool hedge{false};
+        // 0 - p95 полного времени хоста из telemetry
+        std::chrono::milliseconds hedge_after{};
+        priority prio{priority::normal};
+    };
+
+    // ограничения на передачу запросов в curl_multi
+    // сверх них запрос ждет в очереди своего класса
+    struct limits
+    {
+        // одновременных запросов, 0 - без ограничения
+        std::size_t max_running{};
+        // одновременных запросов к одному хосту, 0 - без ограничения
+        std::size_t max_per_host{};
+        // ожидающих запросов, при переполнении get бросает исключение
+        std::size_t max_queued{4096};
+    };
+
+    struct admission_stat
+    {
+        std::array<std::size_t, priority_count> queued{};
+        // допущенные запросы, дублирующие не считаются
+        std::size_t active{};
+        std::size_t rejected{};
+        // запросы с истекшим сроком еще в очереди
+        std::size_t expired{};
+        // время ожидания допуска по классам, мкс
+        std::array<histogram::snapshot, priority_count> wait{};
+    };
+
+    // заполненность пула операций
+    struct pool_stat
+    {
+        std::size_t running{};
+        std::size_t complete{};
+        // готовые к повторному использованию
+        std::size_t idle{};
+        // новые easy хендлы
+        std::size_t created{};
+        // запросы на переиспользованных хендлах
+        std::size_t reused{};
+        // повторные попытки
+        std::size_t retried{};
+        // дублирующие запросы и сколько из них ответили первыми
+        std::size_t hedged{};
+        std::size_t hedge_won{};
+    };
+
 private:
     queue_ref queue_;
     evs timer_{};
@@ -69,6 +150,30 @@ private:
 
     operation_list_type running_{};
     operation_list_type complete_{};
+    // пул завершенных операций
+    // узлы переносятся между списками через splice без аллокаций
+    operation_list_type idle_{};
+    std::size_t idle_max_{64};
+    std::size_t created_{};
+    std::size_t reused_{};
+    std::size_t retried_{};
+    std::size_t hedged_{};
+    std::size_t hedge_won_{};
+
+    // задержка дублирования пока у хоста нет статистики
+    std::chrono::milliseconds hedge_default_{200};
+    std::minstd_rand jitter_{std::random_device()()};
+
+    std::shared_ptr<telemetry> telemetry_{};
+
+    // очередь допуска, по списку на класс приоритета
+    std::array<operation_list_type, priority_count> queued_{};
+    limits limits_{};
+    std::size_t active_{};
+    std::unordered_map<std::string, std::size_t> host_active_{};
+    std::size_t rejected_{};
+    std::size_t expired_{};
+    std::array<histogram, priority_count> wait_{};
 
     class client_operation
         : public operation
@@ -76,7 +181,35 @@ private:
     private:
         operation_ptr_type ptr_{};
 
+        static void timer_cb(evutil_socket_t, event_flag, void *arg) noexcept
+        {
+            assert(arg);
+            auto& op = *static_cast<client_operation*>(arg);
+            op.owner_->on_timer(op);
+        }
+
     public:
+        client *owner_{nullptr};
+        policy policy_{};
+        clock::time_point deadline_{};
+        unsigned attempt_{};
+        // парный запрос при дублировании
+        client_operation *twin_{nullptr};
+        bool hedge_copy_{false};
+        // ожидание повторной попытки
+        bool retry_wait_{false};
+        // host[:port] запроса, емкость сохраняется между запросами
+        std::string host_{};
+        // занимает место в лимитах клиента
+        bool admitted_{false};
+        // ждет в очереди допуска
+        bool queued_{false};
+        clock::time_point queued_at_{};
+        // повтор или запуск дублирующего запроса
+        ev_stack timer_{};
+
+        using operation::set;
+
         client_operation(detail::base_resp *resp)
             : operation(resp)
         {
@@ -87,15 +220,43 @@ private:
             : operation(resp)
         {
             assert(resp);
-            resp->assign(handle());
+            init(resp, url);
+        }
+
+        client_operation(detail::base_resp *resp, easy_handle_t easy)
+            : operation(resp, easy)
+        {   }
+
+        void init(detail::base_resp *resp, const std::string& url)
+        {
+            assert(resp);
+            resp->assign(handle(), inhdr_);
             set_opt(handle(), CURLOPT_PRIVATE, this);
-            operation::set(url);
+            set(url);
 
 #ifndef NDEBUG
             operation::set(CURLOPT_VERBOSE, 1l);
 #endif
         }
 
+        // повторное использование easy хендла из пула
+        void reuse(detail::base_resp *resp)
+        {
+            set_opt(handle(), CURLOPT_PRIVATE, this);
+            if (resp)
+            {
+                resp->assign(handle(), inhdr_);
+                resp_.reset(resp);
+            }
+        }
+
+        void reuse(detail::base_resp *resp, const std::string& url)
+        {
+            assert(resp);
+            resp_.reset(resp);
+            init(resp, url);
+        }
+
         void assign(operation_ptr_type ptr) noexcept
         {
             ptr_ = ptr;
@@ -123,9 +284,73 @@ private:
         void reset(detail::base_resp *resp)
         {
             assert(resp);
-            resp->assign(handle());
+            resp->assign(handle(), inhdr_);
             resp_.reset(resp);
         }
+
+        void set(const policy& value) noexcept
+        {
+            policy_ = value;
+        }
+
+        void set(const std::string& url)
+        {
+            operation::set(url);
+            host_.assign(host_of(url));
+        }
+
+        std::size_t prio() const noexcept
+        {
+            auto rc = static_cast<std::size_t>(policy_.prio);
+            return (rc < priority_count) ? rc : priority_count - 1;
+        }
+
+        void arm(queue_ref queue, std::chrono::milliseconds delay)
+        {
+            if (timer_.empty())
+                timer_.create(queue, -1, EV_TIMEOUT, timer_cb, this);
+            timer_.add(delay);
+        }
+
+        void disarm() noexcept
+        {
+            if (!timer_.empty())
+                event_del(timer_.handle());
+        }
+
+        // копия для дублирующего запроса
+        // опции копирует curl_easy_duphandle, хидеры и обработчик - мы
+        void hedge_from(const client_operation& other)
+        {
+            outhdr_ = other.outhdr_;
+            policy_ = other.policy_;
+            host_ = other.host_;
+            deadline_ = other.deadline_;
+            attempt_ = other.attempt_;
+            hedge_copy_ = true;
+            set_opt(handle(), CURLOPT_PRIVATE, this);
+            resp_->assign(handle(), inhdr_);
+        }
+
+        detail::base_resp* clone_resp() const
+        {
+            return resp_->clone();
+        }
+
+        void recycle() noexcept
+        {
+            disarm();
+            policy_ = policy();
+            deadline_ = clock::time_point();
+            attempt_ = 0;
+            twin_ = nullptr;
+            hedge_copy_ = false;
+            retry_wait_ = false;
+            host_.clear();
+            admitted_ = false;
+            queued_ = false;
+            operation::recycle();
+        }
     };
 
     client(client&) = delete;
@@ -297,8 +522,39 @@ private:
     {
         try
         {
+            if (telemetry_)
+                telemetry_->record(req.handle(), code);
+
+            if (retry(req, code))
+                return;
+
+            if (req.twin_)
+            {
+                auto& twin = *req.twin_;
+                req.twin_ = twin.twin_ = nullptr;
+
+                // ошибка, ждем ответа от пары
+                if (code != CURLE_OK)
+                {
+                    twin.hedge_copy_ = false;
+                    // место в лимитах переходит паре, только если оно было
+                    // у отказавшего, дубль его не занимает
+                    twin.admitted_ |= req.admitted_;
+                    req.admitted_ = false;
+                    release(running_, req.id());
+                    return;
+                }
+
+                if (req.hedge_copy_)
+                    ++hedge_won_;
+
+                // отменяем проигравшего
+                remove(twin);
+                release(running_, twin.id());
+            }
+
             req.done(code);
-            running_.erase(req.id());
+            release(running_, req.id());
         }
         catch (const std::exception& e)
         {
@@ -317,10 +573,13 @@ private:
             for (auto& req : list)
             {
                 remove(req);
-                req.done(code);
+                // у пары один обработчик на двоих
+                if (!(req.hedge_copy_ && req.twin_))
+                    req.done(code);
             }
 
-            list.clear();
+            while (!list.empty())
+                release(list, list.begin());
         }
         catch (const std::exception& e)
         {
@@ -362,11 +621,15 @@ private:
 
         dispatch_force(complete_, CURLE_RECV_ERROR);
 
+        pump();
+
         return count;
     }
 
     void clean() noexcept
     {
+        for (auto& q : queued_)
+            dispatch_force(q, CURLE_READ_ERROR);
         dispatch_force(running_, CURLE_READ_ERROR);
         dispatch_force(complete_, CURLE_READ_ERROR);
     }
@@ -397,17 +660,364 @@ private:
         return result;
     }
 
+    static bool retryable(CURLcode code) noexcept
+    {
+        switch (code)
+        {
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_SSL_CONNECT_ERROR:
+            return true;
+        default:;
+        }
+        return false;
+    }
+
+    std::chrono::milliseconds backoff(const policy& p, unsigned attempt)
+    {
+        auto cap = p.backoff;
+        for (unsigned i = 0; (i < attempt) && (cap < p.backoff_max); ++i)
+            cap *= 2;
+        cap = (std::min)(cap, p.backoff_max);
+
+        std::uniform_int_distribution<long long> dist(0, cap.count());
+        return std::chrono::milliseconds(dist(jitter_));
+    }
+
+    std::chrono::milliseconds hedge_delay(client_operation& req)
+    {
+        auto& p = req.policy_;
+        if (p.hedge_after.count() > 0)
+            return p.hedge_after;
+
+        if (telemetry_)
+        {
+            // запрос еще не выполнен, хост берем из url
+            auto usec = telemetry_->percentile(req.host_, 0.95);
+            if (usec)
+            {
+                return std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::microseconds(usec));
+            }
+        }
+
+        return hedge_default_;
+    }
+
+    // очередная попытка, срок пересчитывается в CURLOPT_TIMEOUT_MS
+    void submit(client_operation& req)
+    {
+        if (req.deadline_ != clock::time_point())
+        {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                req.deadline_ - clock::now()).count();
+            set_opt(req.handle(), CURLOPT_TIMEOUT_MS,
+                static_cast<long>((std::max)(left, decltype(left){1})));
+        }
+
+        req.perform(handle());
+    }
+
+    std::size_t queued() const noexcept
+    {
+        std::size_t rc = 0;
+        for (auto& q : queued_)
+            rc += q.size();
+        return rc;
+    }
+
+    // проверка до создания запроса, чтобы не отдавать висячую операцию
+    void check_admission()
+    {
+        if (queued() >= limits_.max_queued)
+        {
+            ++rejected_;
+            throw std::runtime_error("curl admission queue full");
+        }
+    }
+
+    bool can_admit(const client_operation& req) const noexcept
+    {
+        if (limits_.max_running && (active_ >= limits_.max_running))
+            return false;
+
+        if (limits_.max_per_host)
+        {
+            auto f = host_active_.find(req.host_);
+            if ((f != host_active_.end()) &&
+                (f->second >= limits_.max_per_host))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void admit(client_operation& req)
+    {
+        req.admitted_ = true;
+        ++active_;
+        ++host_active_[req.host_];
+
+        if (req.policy_.hedge)
+            req.arm(base(), hedge_delay(req));
+
+        submit(req);
+    }
+
+    // место освобождается при возврате операции в пул
+    void leave(client_operation& req) noexcept
+    {
+        req.admitted_ = false;
+        --active_;
+
+        auto f = host_active_.find(req.host_);
+        if ((f != host_active_.end()) && f->second)
+            --f->second;
+    }
+
+    void start(client_operation& req)
+    {
+        req.owner_ = this;
+
+        auto& p = req.policy_;
+        if (p.deadline.count() > 0)
+            req.deadline_ = clock::now() + p.deadline;
+
+        // ожидающие того же класса не обгоняются
+        if (queued_[req.prio()].empty() && can_admit(req))
+        {
+            admit(req);
+            return;
+        }
+
+        req.queued_ = true;
+        req.queued_at_ = clock::now();
+        auto& q = queued_[req.prio()];
+        q.splice(q.end(), running_, req.id());
+
+        // срок истекает в очереди
+        if (req.deadline_ != clock::time_point())
+        {
+            req.arm(base(), std::chrono::duration_cast<
+                std::chrono::milliseconds>(req.deadline_ - req.queued_at_));
+        }
+    }
+
+    // из очереди в curl_multi
+    void dequeue(client_operation& req) noexcept
+    {
+        auto prio = req.prio();
+        req.queued_ = false;
+        req.disarm();
+        running_.splice(running_.end(), queued_[prio], req.id());
+
+        auto wait = clock::now() - req.queued_at_;
+        wait_[prio].add(static_cast<std::uint64_t>(std::chrono::duration_cast<
+            std::chrono::microseconds>(wait).count()));
+    }
+
+    // запрос не дождался допуска
+    void expire(client_operation& req) noexcept
+    {
+        dequeue(req);
+        ++expired_;
+        try
+        {
+            req.done(CURLE_OPERATION_TIMEDOUT);
+        }
+        catch (const std::exception& e)
+        {
+            on_error(e);
+        }
+        release(running_, req.id());
+    }
+
+    // допуск ожидающих, строго по классам
+    // запрос к занятому хосту пропускается, хосты за ним могут пройти
+    void pump() noexcept
+    {
+        for (auto& q : queued_)
+        {
+            for (auto i = q.begin(); i != q.end(); )
+            {
+                if (limits_.max_running && (active_ >= limits_.max_running))
+                    return;
+
+                auto& req = *i++;
+                if (!can_admit(req))
+                    continue;
+
+                dequeue(req);
+                try
+                {
+                    admit(req);
+                }
+                catch (const std::exception& e)
+                {
+                    on_error(e);
+                    done(req, CURLE_FAILED_INIT);
+                }
+            }
+        }
+    }
+
+    bool retry(client_operation& req, CURLcode code)
+    {
+        auto& p = req.policy_;
+        if (req.hedge_copy_ || (req.attempt_ >= p.retries) || !retryable(code))
+            return false;
+
+        auto delay = backoff(p, req.attempt_);
+        if ((req.deadline_ != clock::time_point()) &&
+            (clock::now() + delay >= req.deadline_))
+        {
+            return false;
+        }
+
+        ++req.attempt_;
+        ++retried_;
+        req.restart();
+        req.retry_wait_ = true;
+        req.arm(base(), delay);
+        return true;
+    }
+
+    void hedge(client_operation& req)
+    {
+        if (req.twin_ || req.hedge_copy_)
+            return;
+
+        // есть ожидающие - лишнюю нагрузку не создаем
+        if (queued())
+            return;
+
+        std::unique_ptr<detail::base_resp> resp(req.clone_resp());
+        if (!resp)
+            return;
+
+        auto easy = curl_easy_duphandle(req.handle());
+        if (!easy)
+            throw std::runtime_error("curl_easy_duphandle");
+
+        auto ptr = running_.emplace(running_.end(), resp.release(), easy);
+        ptr->assign(ptr);
+        ptr->owner_ = this;
+        ptr->hedge_from(req);
+
+        ptr->twin_ = &req;
+        req.twin_ = &*ptr;
+        ++hedged_;
+
+        try
+        {
+            submit(*ptr);
+        }
+        catch (...)
+        {
+            req.twin_ = nullptr;
+            release(running_, ptr);
+            throw;
+        }
+    }
+
+    void on_timer(client_operation& req) noexcept
+    {
+        if (req.queued_)
+        {
+            expire(req);
+            return;
+        }
+
+        try
+        {
+            if (req.retry_wait_)
+            {
+                req.retry_wait_ = false;
+                submit(req);
+            }
+            else
+                hedge(req);
+        }
+        catch (const std::exception& e)
+        {
+            on_error(e);
+            if (!req.twin_)
+                done(req, CURLE_FAILED_INIT);
+            pump();
+        }
+    }
+
+    // завершенная операция возвращается в пул
+    void release(operation_list_type& list, operation_ptr_type ptr) noexcept
+    {
+        if (ptr->admitted_)
+            leave(*ptr);
+
+        if (idle_.size() < idle_max_)
+        {
+            ptr->recycle();
+            idle_.splice(idle_.end(), list, ptr);
+        }
+        else
+            list.erase(ptr);
+    }
+
+    // операция из пула
+    template<class F>
+    client_operation& acquire(F init)
+    {
+        assert(!idle_.empty());
+
+        auto ptr = idle_.begin();
+        running_.splice(running_.end(), idle_, ptr);
+        try
+        {
+            init(*ptr);
+        }
+        catch (...)
+        {
+            release(running_, ptr);
+            throw;
+        }
+
+        ++reused_;
+        return *ptr;
+    }
+
     client_operation& create_request()
     {
+        if (!idle_.empty())
+        {
+            return acquire([](client_operation& op) {
+                op.reuse(nullptr);
+            });
+        }
+
         auto ptr = running_.emplace(running_.end(), nullptr);
         ptr->assign(ptr);
+        ++created_;
         return *ptr;
     }
 
     client_operation& create_request(const std::string& url, detail::base_resp *resp)
     {
+        if (!idle_.empty())
+        {
+            return acquire([&](client_operation& op) {
+                op.reuse(resp, url);
+            });
+        }
+
         auto ptr = running_.emplace(running_.end(), resp, std::cref(url));
         ptr->assign(ptr);
+        ++created_;
         return *ptr;
     }
 
@@ -456,6 +1066,68 @@ public:
         error_fn_ = std::move(fn);
     }
 
+    // сколько завершенных операций держать для повторного использования
+    // 0 - не использовать пул
+    void set_pool_size(std::size_t size)
+    {
+        idle_max_ = size;
+        while (idle_.size() > idle_max_)
+            idle_.pop_back();
+    }
+
+    // сбор времени, объемов и ошибок по хостам
+    // один сборщик можно отдать нескольким клиентам одного потока
+    void set(std::shared_ptr<telemetry> value) noexcept
+    {
+        telemetry_ = std::move(value);
+    }
+
+    // ограничения допуска, уже ожидающие запросы проверяются заново
+    void set(const limits& value)
+    {
+        limits_ = value;
+        pump();
+    }
+
+    admission_stat admission() const noexcept
+    {
+        admission_stat rc;
+        for (std::size_t i = 0; i < priority_count; ++i)
+        {
+            rc.queued[i] = queued_[i].size();
+            rc.wait[i] = wait_[i].get();
+        }
+        rc.active = active_;
+        rc.rejected = rejected_;
+        rc.expired = expired_;
+        return rc;
+    }
+
+    // задержка дублирования для хостов без статистики
+    void set_hedge_default(std::chrono::milliseconds value) noexcept
+    {
+        hedge_default_ = value;
+    }
+
+    std::shared_ptr<telemetry> get_telemetry() const noexcept
+    {
+        return telemetry_;
+    }
+
+    pool_stat stat() const noexcept
+    {
+        pool_stat rc;
+        rc.running = running_.size();
+        rc.complete = complete_.size();
+        rc.idle = idle_.size();
+        rc.created = created_;
+        rc.reused = reused_;
+        rc.retried = retried_;
+        rc.hedged = hedged_;
+        rc.hedge_won = hedge_won_;
+        return rc;
+    }
+
     class get_req
     {
         client_operation& client_op_;
@@ -477,6 +1149,16 @@ public:
             client_op_.push_header(kv);
         }
 
+        void set(header_template hdr) noexcept
+        {
+            client_op_.set(std::move(hdr));
+        }
+
+        void set(const policy& p) noexcept
+        {
+            client_op_.set(p);
+        }
+
         void set(const std::string& url)
         {
             client_op_.set(url);
@@ -512,11 +1194,13 @@ public:
     template<class F>
     auto& get(F fn)
     {
+        check_admission();
+
         auto& req = create_request();
         try
         {
             fn(get_req(req));
-            req.perform(handle());
+            start(req);
             return req;
         }
         catch (const std::exception& e)
@@ -531,13 +1215,30 @@ public:
     template<class F>
     auto& get(const std::string& url, F fn)
     {
+        check_admission();
 
         using Arg0 = typename stx::lambda_type<decltype(fn)>::arg<0>::type;
 
         auto& req = create_request(url,
             new detail::get_resp<Arg0>(std::move(fn)));
 
-        req.perform(handle());
+        start(req);
+
+        return req;
+    }
+
+    template<class F>
+    auto& get(const std::string& url, F fn, const policy& p)
+    {
+        check_admission();
+
+        using Arg0 = typename stx::lambda_type<decltype(fn)>::arg<0>::type;
+
+        auto& req = create_request(url,
+            new detail::get_resp<Arg0>(std::move(fn)));
+
+        req.set(p);
+        start(req);
 
         return req;
     }
@@ -4,6 +4,7 @@
 
 #include <functional>
 #include <exception>
+#include <string_view>
 #include <cassert>
 
 namespace btpro {
@@ -41,6 +42,22 @@ void set_opt(multi_handle_t handle, CURLMoption option, const T& value)
         throw std::runtime_error(str_error(code));
 }
 
+// host[:port] из url вида scheme://[user@]host[:port]/path
+static inline std::string_view host_of(std::string_view url) noexcept
+{
+    auto f = url.find("://");
+    if (f != std::string_view::npos)
+        url = url.substr(f + 3);
+
+    url = url.substr(0, url.find_first_of("/?#"));
+
+    f = url.rfind('@');
+    if (f != std::string_view::npos)
+        url = url.substr(f + 1);
+
+    return url;
+}
+
 struct launch
 {
     explicit launch(long f)
@@ -0,0 +1,381 @@
+#pragma once
+
+#include "btpro/curl/header/known.hpp"
+
+#include <vector>
+#include <string>
+#include <iterator>
+
+namespace btpro {
+namespace curl {
+namespace header {
+
+// хидеры ответа без аллокаций на каждую строку
+// все ключи и значения лежат подряд в одном буфере (arena)
+// индекс - открытая адресация по calc_hash
+// clear сохраняет емкость, объект переиспользуется между запросами
+class flat_store
+{
+public:
+    using hash_type = store::hash_type;
+    using value_type = std::pair<hash_type,
+        std::pair<std::string_view, std::string_view>>;
+
+private:
+    constexpr static auto npos = ~std::uint32_t{};
+
+    struct entry
+    {
+        hash_type hash;
+        std::uint32_t key_off;
+        std::uint32_t key_len;
+        std::uint32_t value_off;
+        std::uint32_t value_len;
+        // следующее значение с тем же ключом
+        std::uint32_t next;
+        // не первое значение ключа, в индекс не попадает
+        bool dup;
+    };
+
+    std::vector<char> arena_{};
+    std::vector<entry> entry_{};
+    // номер записи + 1, 0 - свободно
+    std::vector<std::uint32_t> slot_{};
+    // первая запись известного хидера, тоже + 1
+    std::array<std::uint32_t, known::count> known_{};
+    std::int64_t content_length_{-1};
+
+    std::uint32_t put(std::string_view text)
+    {
+        auto off = arena_.size();
+        arena_.insert(arena_.end(), text.begin(), text.end());
+        return static_cast<std::uint32_t>(off);
+    }
+
+    std::string_view key_of(const entry& e) const noexcept
+    {
+        return std::string_view(arena_.data() + e.key_off, e.key_len);
+    }
+
+    std::string_view value_of(const entry& e) const noexcept
+    {
+        return std::string_view(arena_.data() + e.value_off, e.value_len);
+    }
+
+    static bool iequal(std::string_view a, std::string_view b) noexcept
+    {
+        if (a.size() != b.size())
+            return false;
+
+        for (std::size_t i = 0; i < a.size(); ++i)
+        {
+            if (store::tolower(a[i]) != store::tolower(b[i]))
+                return false;
+        }
+
+        return true;
+    }
+
+    std::size_t mask() const noexcept
+    {
+        return slot_.size() - 1;
+    }
+
+    // слот с ключом или первый свободный
+    std::size_t lookup(hash_type h, std::string_view key) const noexcept
+    {
+        auto i = static_cast<std::size_t>(h) & mask();
+        while (slot_[i])
+        {
+            auto& e = entry_[slot_[i] - 1];
+            if ((e.hash == h) && iequal(key_of(e), key))
+                break;
+            i = (i + 1) & mask();
+        }
+        return i;
+    }
+
+    void rehash(std::size_t size)
+    {
+        slot_.assign(size, 0);
+        for (std::uint32_t n = 0; n < entry_.size(); ++n)
+        {
+            auto& e = entry_[n];
+            if (!e.dup)
+            {
+                auto i = static_cast<std::size_t>(e.hash) & mask();
+                while (slot_[i])
+                    i = (i + 1) & mask();
+                slot_[i] = n + 1;
+            }
+        }
+    }
+
+public:
+    class const_iterator
+    {
+        const flat_store *store_{nullptr};
+        std::size_t pos_{};
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = flat_store::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        const_iterator() = default;
+
+        const_iterator(const flat_store *store, std::size_t pos) noexcept
+            : store_(store)
+            , pos_(pos)
+        {   }
+
+        value_type operator*() const noexcept
+        {
+            auto& e = store_->entry_[pos_];
+            return value_type(e.hash, std::make_pair(
+                store_->key_of(e), store_->value_of(e)));
+        }
+
+        const_iterator& operator++() noexcept
+        {
+            ++pos_;
+            return *this;
+        }
+
+        const_iterator operator++(int) noexcept
+        {
+            auto tmp = *this;
+            ++pos_;
+            return tmp;
+        }
+
+        bool operator==(const const_iterator& other) const noexcept
+        {
+            return pos_ == other.pos_;
+        }
+
+        bool operator!=(const const_iterator& other) const noexcept
+        {
+            return pos_ != other.pos_;
+        }
+    };
+
+    using iterator = const_iterator;
+
+    // arena - байт под хидеры, count - ожидаемое число строк
+    explicit flat_store(std::size_t arena = 1024, std::size_t count = 16)
+    {
+        arena_.reserve(arena);
+        entry_.reserve(count);
+
+        std::size_t size = 16;
+        while (size < count * 2)
+            size <<= 1;
+        slot_.assign(size, 0);
+    }
+
+    constexpr
+    static auto to_hash(std::string_view key) noexcept
+    {
+        assert(!key.empty());
+
+        return store::calc_hash(key);
+    }
+
+    template<class I>
+    static auto key(I iter) noexcept
+    {
+        return std::get<0>(std::get<1>(*iter));
+    }
+
+    template<class I>
+    static auto value(I iter) noexcept
+    {
+        return std::get<1>(std::get<1>(*iter));
+    }
+
+    const_iterator find(std::string_view key) const noexcept
+    {
+        auto i = lookup(to_hash(key), key);
+        return (slot_[i]) ?
+            const_iterator(this, slot_[i] - 1) : end();
+    }
+
+    void insert(std::string_view key, std::string_view value)
+    {
+        assert(!key.empty());
+        assert(!value.empty());
+
+        auto h = to_hash(key);
+        auto i = lookup(h, key);
+
+        auto n = static_cast<std::uint32_t>(entry_.size());
+        if (slot_[i])
+        {
+            // повторный ключ, дописываем в конец цепочки
+            auto p = slot_[i] - 1;
+            while (entry_[p].next != npos)
+                p = entry_[p].next;
+
+            auto& last = entry_[p];
+            if (value_of(last) == value)
+                return;
+
+            entry_.push_back(entry{h, last.key_off, last.key_len,
+                put(value), static_cast<std::uint32_t>(value.size()),
+                npos, true});
+            entry_[p].next = n;
+            return;
+        }
+
+        auto key_off = put(key);
+        entry_.push_back(entry{h, key_off,
+            static_cast<std::uint32_t>(key.size()),
+            put(value), static_cast<std::uint32_t>(value.size()),
+            npos, false});
+        slot_[i] = n + 1;
+
+        auto k = known::find(h, key);
+        if (k != id::unknown)
+        {
+            known_[static_cast<std::size_t>(k)] = n + 1;
+            if (k == id::content_length)
+                content_length_ = known::to_int(value);
+        }
+
+        // заполнение не больше половины
+        if (entry_.size() * 2 > slot_.size())
+            rehash(slot_.size() * 2);
+    }
+
+    std::string_view get(std::string_view key) const noexcept
+    {
+        return get_first(key);
+    }
+
+    // известный хидер без хеширования и сравнения строк
+    std::string_view get(id key) const noexcept
+    {
+        auto n = known_[static_cast<std::size_t>(key)];
+        return (n) ? value_of(entry_[n - 1]) : std::string_view();
+    }
+
+    bool has(id key) const noexcept
+    {
+        return known_[static_cast<std::size_t>(key)] != 0;
+    }
+
+    // -1 если хидера нет или значение не число
+    std::int64_t content_length() const noexcept
+    {
+        return content_length_;
+    }
+
+    std::string_view content_type() const noexcept
+    {
+        return get(id::content_type);
+    }
+
+    // Retry-After в секундах, -1 если хидера нет или это дата
+    std::int64_t retry_after() const noexcept
+    {
+        return known::to_int(get(id::retry_after));
+    }
+
+    std::string_view get_first(std::string_view key) const noexcept
+    {
+        auto h = to_hash(key);
+        auto k = known::find(h, key);
+        if (k != id::unknown)
+            return get(k);
+
+        auto i = lookup(h, key);
+        return (slot_[i]) ?
+            value_of(entry_[slot_[i] - 1]) : std::string_view();
+    }
+
+    // все значения ключа в порядке получения
+    template<class F>
+    void for_each(std::string_view key, F fn) const
+    {
+        auto i = lookup(to_hash(key), key);
+        for (auto n = slot_[i]; n; )
+        {
+            auto& e = entry_[n - 1];
+            fn(value_of(e));
+            n = e.next + 1;
+        }
+    }
+
+    // сброс перед следующим ответом, память остается
+    void clear() noexcept
+    {
+        arena_.clear();
+        entry_.clear();
+        std::fill(slot_.begin(), slot_.end(), 0);
+        known_.fill(0);
+        content_length_ = -1;
+    }
+
+    const_iterator begin() const noexcept
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const noexcept
+    {
+        return const_iterator(this, entry_.size());
+    }
+
+    const_iterator cbegin() const noexcept
+    {
+        return begin();
+    }
+
+    const_iterator cend() const noexcept
+    {
+        return end();
+    }
+
+    std::size_t size() const noexcept
+    {
+        return entry_.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return entry_.empty();
+    }
+
+    // занято байт в arena
+    std::size_t bytes() const noexcept
+    {
+        return arena_.size();
+    }
+
+    std::string dump() const
+    {
+        std::string rc;
+        rc.reserve(arena_.size() + entry_.size() * 2);
+
+        for (auto& e : entry_)
+        {
+            if (!rc.empty())
+                rc += '\n';
+            rc += key_of(e);
+            rc += ':';
+            rc += value_of(e);
+        }
+
+        return rc;
+    }
+};
+
+using flat_store_cref = const flat_store&;
+using flat_store_ref = flat_store&;
+
+} // namespace header
+} // namespace curl
+} // namespace btpro
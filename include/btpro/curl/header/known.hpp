@@ -0,0 +1,193 @@
+#pragma once
+
+#include "btpro/curl/header/store.hpp"
+
+#include <array>
+
+namespace btpro {
+namespace curl {
+namespace header {
+
+// известные хидеры ответа
+// номер стабилен, новые добавлять только перед count
+enum class id
+    : std::uint8_t
+{
+    unknown = 0,
+    accept_ranges,
+    age,
+    alt_svc,
+    cache_control,
+    connection,
+    content_disposition,
+    content_encoding,
+    content_length,
+    content_range,
+    content_type,
+    date,
+    etag,
+    expires,
+    keep_alive,
+    last_modified,
+    link,
+    location,
+    proxy_authenticate,
+    retry_after,
+    sec_websocket_accept,
+    sec_websocket_extensions,
+    sec_websocket_protocol,
+    server,
+    set_cookie,
+    strict_transport_security,
+    transfer_encoding,
+    upgrade,
+    vary,
+    www_authenticate,
+    x_request_id,
+    count
+};
+
+namespace known {
+
+using hash_type = store::hash_type;
+
+constexpr static std::size_t count = static_cast<std::size_t>(id::count);
+
+// в порядке id, имена в нижнем регистре
+constexpr static std::string_view name[count] = {
+    std::string_view(),
+    "accept-ranges",
+    "age",
+    "alt-svc",
+    "cache-control",
+    "connection",
+    "content-disposition",
+    "content-encoding",
+    "content-length",
+    "content-range",
+    "content-type",
+    "date",
+    "etag",
+    "expires",
+    "keep-alive",
+    "last-modified",
+    "link",
+    "location",
+    "proxy-authenticate",
+    "retry-after",
+    "sec-websocket-accept",
+    "sec-websocket-extensions",
+    "sec-websocket-protocol",
+    "server",
+    "set-cookie",
+    "strict-transport-security",
+    "transfer-encoding",
+    "upgrade",
+    "vary",
+    "www-authenticate",
+    "x-request-id"
+};
+
+constexpr static hash_type hash_of(id value) noexcept
+{
+    return store::calc_hash(name[static_cast<std::size_t>(value)]);
+}
+
+namespace detail {
+
+// размер таблицы идеального хеша
+constexpr static unsigned table_bits = 7;
+constexpr static std::size_t table_size = std::size_t{1} << table_bits;
+
+constexpr static std::size_t slot(hash_type h, hash_type mul) noexcept
+{
+    return static_cast<std::size_t>((h * mul) >> (64 - table_bits));
+}
+
+// множитель при котором все известные имена попадают в разные слоты
+constexpr static hash_type find_mul() noexcept
+{
+    for (hash_type k = 0; k < 4096; ++k)
+    {
+        auto mul = 0x9e3779b97f4a7c15ull + (k << 1);
+        bool used[table_size] = {};
+        bool ok = true;
+        for (std::size_t i = 1; ok && (i < count); ++i)
+        {
+            auto s = slot(store::calc_hash(name[i]), mul);
+            ok = !used[s];
+            used[s] = true;
+        }
+
+        if (ok)
+            return mul;
+    }
+    return 0;
+}
+
+constexpr static hash_type mul = find_mul();
+static_assert(mul != 0, "no perfect hash for known headers");
+
+struct table_type
+{
+    id value[table_size]{};
+    hash_type hash[table_size]{};
+};
+
+constexpr static table_type make_table() noexcept
+{
+    table_type t{};
+    for (std::size_t i = 1; i < count; ++i)
+    {
+        auto h = store::calc_hash(name[i]);
+        auto s = slot(h, mul);
+        t.value[s] = static_cast<id>(i);
+        t.hash[s] = h;
+    }
+    return t;
+}
+
+constexpr static table_type table = make_table();
+
+} // namespace detail
+
+// h - calc_hash от key
+// одно обращение к таблице и сравнение длины
+constexpr static id find(hash_type h, std::string_view key) noexcept
+{
+    auto s = detail::slot(h, detail::mul);
+    auto value = detail::table.value[s];
+    return ((detail::table.hash[s] == h) &&
+        (name[static_cast<std::size_t>(value)].size() == key.size())) ?
+            value : id::unknown;
+}
+
+constexpr static id find(std::string_view key) noexcept
+{
+    return find(store::calc_hash(key), key);
+}
+
+static_assert(find("Content-Length") == id::content_length);
+static_assert(find("x-request-id") == id::x_request_id);
+static_assert(find("x-unknown") == id::unknown);
+
+// десятичное число без знака, -1 если формат неверный
+constexpr static std::int64_t to_int(std::string_view text) noexcept
+{
+    if (text.empty() || (text.size() > 18))
+        return -1;
+
+    std::int64_t rc = 0;
+    for (auto c : text)
+    {
+        if ((c < '0') || (c > '9'))
+            return -1;
+        rc = rc * 10 + (c - '0');
+    }
+    return rc;
+}
+
+} // namespace known
+} // namespace header
+} // namespace curl
+} // namespace btpro
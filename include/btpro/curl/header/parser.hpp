@@ -9,11 +9,12 @@ namespace btpro {
 namespace curl {
 namespace header {
 
-template<class T>
+// S - хранилище хидеров: store или flat_store
+template<class T, class S = store>
 class parser
 {
     T& handler_;
-    store_ref hdr_;
+    S& hdr_;
 
     template<class F>
     struct proxy
@@ -42,6 +43,14 @@ class parser
                 return 0;
             }
 
+            // строка статуса - начало очередного ответа
+            // (редирект, 100-continue или повторное использование)
+            if (kv.substr(0, 5) == "HTTP/"sv)
+            {
+                hdr_.clear();
+                return size;
+            }
+
             // rtrim
             while (!kv.empty() &&
                 ((kv.back() == '\n') || (kv.back() == '\r') ||
@@ -76,7 +85,7 @@ class parser
     }
 
 public:
-    parser(T& handler, store_ref hdr) noexcept
+    parser(T& handler, S& hdr) noexcept
         : handler_(handler)
         , hdr_(hdr)
     {   }
@@ -101,18 +110,18 @@ public:
     }
 };
 
-template<class H>
+template<class H, class S = store>
 class auto_parser
 {
-    parser<H> parser_;
+    parser<H, S> parser_;
     easy_handle_t easy_{nullptr};
 
 public:
-    auto_parser(H& handler, store_ref hdr) noexcept
+    auto_parser(H& handler, S& hdr) noexcept
         : parser_(handler, hdr)
     {   }
 
-    auto_parser(H& handler, store_ref hdr, easy_handle_t easy)
+    auto_parser(H& handler, S& hdr, easy_handle_t easy)
         : parser_(handler, hdr)
         , easy_(easy)
     {
@@ -4,6 +4,7 @@
 #include <limits>
 #include <algorithm>
 #include <unordered_map>
+#include <string>
 #include <string_view>
 
 namespace btpro {
@@ -28,7 +29,7 @@ public:
     constexpr
     static inline char tolower(char c) noexcept
     {
-        return ((c > 'A') && (c < 'Z')) ? c + ('a' - 'A') : c;
+        return ((c >= 'A') && (c <= 'Z')) ? c + ('a' - 'A') : c;
     }
 
     constexpr
@@ -143,6 +144,11 @@ public:
             std::get<1>(f->second) : std::string_view();
     }
 
+    void clear() noexcept
+    {
+        store_.clear();
+    }
+
     void clear_value() noexcept
     {
         auto i = store_.begin(),
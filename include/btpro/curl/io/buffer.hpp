@@ -143,6 +143,11 @@ public:
         return data_.empty();
     }
 
+    void clear()
+    {
+        data_.drain(data_.size());
+    }
+
     std::size_t size() const noexcept
     {
         return data_.size();
@@ -154,7 +154,7 @@ auto accept_encoding(std::string val)
     return basic_option<std::string, CURLOPT_ACCEPT_ENCODING>(std::move(val));
 }
 
-using request_header = basic_slist<CURLOPT_HTTPHEADER>;
+using request_header = basic_header_overlay<CURLOPT_HTTPHEADER>;
 
 } // namespace http
 } // namespace minie
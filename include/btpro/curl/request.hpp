@@ -36,6 +36,8 @@ class operation
 
 protected:
     request_header outhdr_{};
+    // хидеры ответа, емкость сохраняется между запросами
+    header::flat_store inhdr_{};
     std::unique_ptr<detail::base_resp> resp_{};
 
     void reset(detail::base_resp *resp)
@@ -50,6 +52,14 @@ public:
         : resp_(resp)
     {   }
 
+    // владение easy переходит к операции
+    operation(detail::base_resp *resp, easy_handle_t easy) noexcept
+        : easy_(easy, curl_easy_cleanup)
+        , resp_(resp)
+    {
+        assert(easy);
+    }
+
     virtual ~operation()
     {   }
 
@@ -65,6 +75,12 @@ public:
         outhdr_.push_header(kv);
     }
 
+    // общий набор хидеров, push добавляет или заменяет поверх него
+    void set(header_template hdr) noexcept
+    {
+        outhdr_.set(std::move(hdr));
+    }
+
     easy_handle_t handle() const noexcept
     {
         return easy_.get();
@@ -96,6 +112,16 @@ public:
         opt(*this);
     }
 
+    // вернуть операцию в исходное состояние для повторного запроса
+    // curl_easy_reset сохраняет живые соединения, кеш dns и сессии tls
+    void recycle() noexcept
+    {
+        curl_easy_reset(handle());
+        outhdr_.reset();
+        inhdr_.clear();
+        resp_.reset();
+    }
+
     CURLcode perform()
     {
         if (!outhdr_.empty())
@@ -119,6 +145,11 @@ public:
     {
         return resp_->stream();
     }
+
+    void restart()
+    {
+        resp_->restart();
+    }
 };
 
 //template<class Data, class Header, class Protocol>
@@ -4,6 +4,7 @@
 #include "btpro/curl/info.hpp"
 #include "btpro/curl/io/buffer.hpp"
 #include "btpro/curl/header/parser.hpp"
+#include "btpro/curl/header/flat_store.hpp"
 
 #include "btpro/wslay/context.hpp"
 
@@ -11,6 +12,7 @@
 #include "btpro/ssl/rand.hpp"
 #include "btpro/ssl/sha.hpp"
 
+#include <optional>
 #include <string_view>
 
 namespace btpro {
@@ -34,7 +36,7 @@ public:
     }
 
     resp(easy_handle_t easy, CURLcode error,
-         btpro::buffer_ref buffer, header::store_ref) noexcept
+         btpro::buffer_ref buffer, header::flat_store_ref) noexcept
         : easy_(easy)
         , error_(error)
         , buffer_(std::move(buffer))
@@ -68,13 +70,13 @@ public:
 class resp_ext
     : public resp
 {
-    header::store_ref hdr_;
+    header::flat_store_ref hdr_;
 
 public:
     using fn_type = std::function<void(resp_ext)>;
 
     resp_ext(easy_handle_t easy, CURLcode code,
-        btpro::buffer_ref buffer, header::store_ref hdr) noexcept
+        btpro::buffer_ref buffer, header::flat_store_ref hdr) noexcept
         : resp(easy, code, std::move(buffer), hdr)
         , hdr_(hdr)
     {   }
@@ -98,6 +100,37 @@ public:
     {
         return hdr_.get(key);
     }
+
+    // известные хидеры без хеширования строки
+    std::string_view get(header::id key) const noexcept
+    {
+        return hdr_.get(key);
+    }
+
+    bool has(header::id key) const noexcept
+    {
+        return hdr_.has(key);
+    }
+
+    std::int64_t content_length() const noexcept
+    {
+        return hdr_.content_length();
+    }
+
+    std::string_view content_type() const noexcept
+    {
+        return hdr_.content_type();
+    }
+
+    std::int64_t retry_after() const noexcept
+    {
+        return hdr_.retry_after();
+    }
+
+    header::flat_store_cref headers() const noexcept
+    {
+        return hdr_;
+    }
 };
 
 
@@ -113,12 +146,15 @@ protected:
     error_fn_type error_fn_{};
 
 public:
+    virtual ~base_resp() = default;
+
     virtual void set(error_fn_type fn)
     {
         error_fn_ = std::move(fn);
     }
 
-    virtual void assign(easy_handle_t) = 0;
+    // hdr - хидеры операции, переживают recycle и не аллоцируются заново
+    virtual void assign(easy_handle_t, header::flat_store& hdr) = 0;
 
     virtual void done(easy_handle_t, CURLcode) noexcept = 0;
 
@@ -133,6 +169,17 @@ public:
     {
         return false;
     }
+
+    // сброс принятых данных перед повторной попыткой
+    virtual void restart()
+    {   }
+
+    // копия обработчика для дублирующего запроса
+    // nullptr - дублирование не поддерживается
+    virtual base_resp* clone() const
+    {
+        return nullptr;
+    }
 };
 
 template<class T>
@@ -145,13 +192,14 @@ public:
     using this_type = get_resp<T>;
     using inbuf_type = io::buffer<this_type, io::append>;
 
-    using header_fn_type = std::function<bool(header::store_cref)>;
+    using header_fn_type = std::function<bool(header::flat_store_cref)>;
+    using parser_type = header::parser<this_type, header::flat_store>;
 
 private:
     fn_type done_{};
 
-    header::store hdr_{};
-    header::parser<this_type> hparse_{*this, hdr_};
+    header::flat_store *hdr_{nullptr};
+    std::optional<parser_type> hparse_{};
     header_fn_type header_fn_{};
 
     inbuf_type inbuf_{*this};
@@ -160,7 +208,8 @@ private:
     {
         try
         {
-            done_(result_type(easy, code, inbuf_.data(), hdr_));
+            assert(hdr_);
+            done_(result_type(easy, code, inbuf_.data(), *hdr_));
         }
         catch (...)
         {
@@ -174,10 +223,13 @@ public:
         : done_(std::move(fn))
     {   }
 
-    void assign(easy_handle_t easy) override
+    void assign(easy_handle_t easy, header::flat_store& hdr) override
     {
         assert(easy);
-        hparse_.assign(easy);
+        hdr_ = &hdr;
+        hdr_->clear();
+        hparse_.emplace(*this, hdr);
+        hparse_->assign(easy);
         inbuf_.assign(easy);
     }
 
@@ -191,12 +243,27 @@ public:
         header_fn_ = std::move(fn);
     }
 
+    void restart() override
+    {
+        if (hdr_)
+            hdr_->clear();
+        inbuf_.clear();
+    }
+
+    base_resp* clone() const override
+    {
+        auto rc = new get_resp(done_);
+        rc->header_fn_ = header_fn_;
+        rc->error_fn_ = error_fn_;
+        return rc;
+    }
+
     void call(std::exception_ptr ex)
     {
         error(ex);
     }
 
-    bool call(header::store_ref hdr)
+    bool call(header::flat_store_ref hdr)
     {
         return (header_fn_) ?
             header_fn_(hdr) : true;
@@ -212,7 +279,7 @@ class websocket
     // стал ли запрос вебсокетом
     bool stream_{false};
 
-    virtual void assign(easy_handle_t) override
+    virtual void assign(easy_handle_t, header::flat_store&) override
     {
 
     }
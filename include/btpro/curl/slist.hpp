@@ -2,8 +2,13 @@
 
 #include "btpro/curl/curl.hpp"
 
+#include <initializer_list>
+#include <iterator>
+#include <cctype>
 #include <string_view>
 #include <string>
+#include <vector>
+#include <memory>
 
 namespace btpro {
 namespace curl {
@@ -74,5 +79,227 @@ public:
     }
 };
 
+// неизменяемый набор хидеров запроса (авторизация, content-type, ...)
+// собирается один раз, копии разделяют одни и те же строки и узлы
+// узлы curl_slist свои, curl_slist_free_all к ним неприменим
+class header_template
+{
+public:
+    using value_type = std::pair<std::string_view, std::string_view>;
+
+private:
+    struct data
+    {
+        std::vector<std::string> text{};
+        std::vector<curl_slist> node{};
+        // длина имени хидера в каждой строке
+        std::vector<std::size_t> key_len{};
+    };
+
+    std::shared_ptr<const data> data_{};
+
+    static std::string make(std::string_view key, std::string_view val)
+    {
+        std::string text;
+        text.reserve(key.size() + val.size() + 4);
+        text += key;
+        text += ':';
+        text += ' ';
+        text += val;
+        return text;
+    }
+
+    template<class I>
+    static std::shared_ptr<const data> build(I first, I last)
+    {
+        auto d = std::make_shared<data>();
+        auto count = static_cast<std::size_t>(std::distance(first, last));
+        d->text.reserve(count);
+        d->key_len.reserve(count);
+        for (; first != last; ++first)
+        {
+            d->text.push_back(make(first->first, first->second));
+            d->key_len.push_back(first->first.size());
+        }
+
+        // строки больше не двигаются, можно брать указатели
+        d->node.resize(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            d->node[i].data = const_cast<char*>(d->text[i].c_str());
+            d->node[i].next = (i + 1 < count) ? &d->node[i + 1] : nullptr;
+        }
+
+        return d;
+    }
+
+public:
+    header_template() = default;
+
+    header_template(std::initializer_list<value_type> list)
+        : data_(build(list.begin(), list.end()))
+    {   }
+
+    explicit header_template(const std::vector<value_type>& list)
+        : data_(build(list.begin(), list.end()))
+    {   }
+
+    bool empty() const noexcept
+    {
+        return !data_ || data_->node.empty();
+    }
+
+    std::size_t size() const noexcept
+    {
+        return (data_) ? data_->node.size() : 0;
+    }
+
+    // начало списка для curl
+    curl_slist* head() const noexcept
+    {
+        return (empty()) ? nullptr :
+            const_cast<curl_slist*>(data_->node.data());
+    }
+
+    const curl_slist& node(std::size_t i) const noexcept
+    {
+        assert(i < size());
+        return data_->node[i];
+    }
+
+    std::string_view key(std::size_t i) const noexcept
+    {
+        assert(i < size());
+        return std::string_view(data_->text[i].data(), data_->key_len[i]);
+    }
+};
+
+// хидеры конкретного запроса поверх общего шаблона
+// свои строки идут первыми, шаблон подцепляется хвостом без копирования
+// если свой хидер совпадает по имени с хидером шаблона,
+// копируются только узлы шаблона (без строк) и совпавший пропускается
+template<long Opt>
+class basic_header_overlay
+{
+    header_template base_{};
+    std::vector<std::string> text_{};
+    std::vector<std::size_t> key_len_{};
+    mutable std::vector<curl_slist> node_{};
+
+    static bool iequal(std::string_view a, std::string_view b) noexcept
+    {
+        if (a.size() != b.size())
+            return false;
+
+        for (std::size_t i = 0; i < a.size(); ++i)
+        {
+            if (std::tolower(static_cast<unsigned char>(a[i])) !=
+                std::tolower(static_cast<unsigned char>(b[i])))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool overridden(std::string_view key) const noexcept
+    {
+        for (std::size_t i = 0; i < text_.size(); ++i)
+        {
+            if (iequal(key, std::string_view(text_[i].data(), key_len_[i])))
+                return true;
+        }
+        return false;
+    }
+
+    curl_slist* build() const
+    {
+        node_.clear();
+        node_.reserve(text_.size() + base_.size());
+
+        for (auto& text : text_)
+            node_.push_back(curl_slist{const_cast<char*>(text.c_str()), nullptr});
+
+        auto tail = base_.head();
+        for (std::size_t i = 0; i < base_.size(); ++i)
+        {
+            if (overridden(base_.key(i)))
+            {
+                // есть замена, перестраиваем узлы шаблона
+                tail = nullptr;
+                for (std::size_t j = 0; j < base_.size(); ++j)
+                {
+                    if (!overridden(base_.key(j)))
+                        node_.push_back(curl_slist{base_.node(j).data, nullptr});
+                }
+                break;
+            }
+        }
+
+        if (node_.empty())
+            return tail;
+
+        for (std::size_t i = 0; i + 1 < node_.size(); ++i)
+            node_[i].next = &node_[i + 1];
+        node_.back().next = tail;
+
+        return node_.data();
+    }
+
+public:
+    basic_header_overlay() = default;
+
+    explicit basic_header_overlay(header_template base) noexcept
+        : base_(std::move(base))
+    {   }
+
+    void set(header_template base) noexcept
+    {
+        base_ = std::move(base);
+    }
+
+    void push(std::string_view key, std::string_view val)
+    {
+        std::string text;
+        text.reserve(key.size() + val.size() + 4);
+        text += key;
+        text += ':';
+        text += ' ';
+        text += val;
+        text_.push_back(std::move(text));
+        key_len_.push_back(key.size());
+    }
+
+    // формат - "key:value"
+    void push_header(std::string_view value)
+    {
+        auto f = value.find(':');
+        text_.emplace_back(value.data(), value.size());
+        key_len_.push_back((f != std::string_view::npos) ? f : value.size());
+    }
+
+    bool empty() const noexcept
+    {
+        return text_.empty() && base_.empty();
+    }
+
+    // свои хидеры сбрасываются, шаблон тоже
+    void reset() noexcept
+    {
+        base_ = header_template();
+        text_.clear();
+        key_len_.clear();
+        node_.clear();
+    }
+
+    // список должен жить до конца запроса
+    void operator()(easy_handle_t handle) const
+    {
+        assert(handle);
+        set_opt(handle, static_cast<CURLoption>(Opt), build());
+    }
+};
+
 } // namsspace curl
 } // namespace btpro
@@ -0,0 +1,334 @@
+#pragma once
+
+#include "btpro/curl/info.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <string_view>
+
+namespace btpro {
+namespace curl {
+
+// гистограмма времени в микросекундах
+// корзина i - значения в [2^(i-1), 2^i), корзина 0 - ноль
+// запись - relaxed атомики, читать можно из любого потока
+class histogram
+{
+public:
+    constexpr static std::size_t buckets = 40;
+
+    struct snapshot
+    {
+        std::array<std::uint64_t, buckets> bucket{};
+        std::uint64_t count{};
+        std::uint64_t sum{};
+        std::uint64_t max{};
+
+        // перцентиль p (0..1), линейная интерполяция внутри корзины
+        // значения в корзине считаются равномерными, ошибка меньше ширины корзины
+        std::uint64_t percentile(double p) const noexcept
+        {
+            if (!count)
+                return 0;
+
+            auto rank = static_cast<std::uint64_t>(p * count);
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < buckets; ++i)
+            {
+                if (seen + bucket[i] > rank)
+                {
+                    if (!i)
+                        return 0;
+
+                    auto lo = std::uint64_t{1} << (i - 1);
+                    auto hi = (std::min)((std::uint64_t{1} << i) - 1, max);
+                    if (hi <= lo)
+                        return lo;
+
+                    auto part = static_cast<double>(rank - seen + 1) /
+                        static_cast<double>(bucket[i]);
+                    return lo + static_cast<std::uint64_t>(part * (hi - lo));
+                }
+                seen += bucket[i];
+            }
+            return max;
+        }
+
+        std::uint64_t mean() const noexcept
+        {
+            return (count) ? sum / count : 0;
+        }
+    };
+
+private:
+    std::array<std::atomic<std::uint64_t>, buckets> bucket_{};
+    std::atomic<std::uint64_t> count_{};
+    std::atomic<std::uint64_t> sum_{};
+    std::atomic<std::uint64_t> max_{};
+
+    static std::size_t index(std::uint64_t usec) noexcept
+    {
+        std::size_t i = 0;
+        while (usec && (i < buckets - 1))
+        {
+            usec >>= 1;
+            ++i;
+        }
+        return i;
+    }
+
+public:
+    void add(std::uint64_t usec) noexcept
+    {
+        bucket_[index(usec)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(usec, std::memory_order_relaxed);
+
+        auto curr = max_.load(std::memory_order_relaxed);
+        while ((curr < usec) && !max_.compare_exchange_weak(curr, usec,
+            std::memory_order_relaxed))
+        {   }
+    }
+
+    snapshot get() const noexcept
+    {
+        snapshot rc;
+        for (std::size_t i = 0; i < buckets; ++i)
+            rc.bucket[i] = bucket_[i].load(std::memory_order_relaxed);
+        rc.count = count_.load(std::memory_order_relaxed);
+        rc.sum = sum_.load(std::memory_order_relaxed);
+        rc.max = max_.load(std::memory_order_relaxed);
+        return rc;
+    }
+};
+
+// статистика по одному хосту
+class host_stat
+{
+public:
+    // коды ошибок за пределами таблицы попадают в последнюю ячейку
+    constexpr static std::size_t error_codes = 100;
+
+    struct snapshot
+    {
+        std::string host{};
+        histogram::snapshot dns{};
+        histogram::snapshot connect{};
+        histogram::snapshot tls{};
+        histogram::snapshot ttfb{};
+        histogram::snapshot total{};
+        std::uint64_t requests{};
+        std::uint64_t bytes_down{};
+        std::uint64_t bytes_up{};
+        // запросы потребовавшие новое соединение
+        std::uint64_t connects{};
+        // запросы на уже открытом соединении
+        std::uint64_t reused{};
+        std::uint64_t errors{};
+        std::array<std::uint64_t, error_codes> error{};
+    };
+
+private:
+    histogram dns_{};
+    histogram connect_{};
+    histogram tls_{};
+    histogram ttfb_{};
+    histogram total_{};
+    std::atomic<std::uint64_t> requests_{};
+    std::atomic<std::uint64_t> bytes_down_{};
+    std::atomic<std::uint64_t> bytes_up_{};
+    std::atomic<std::uint64_t> connects_{};
+    std::atomic<std::uint64_t> reused_{};
+    std::atomic<std::uint64_t> errors_{};
+    std::array<std::atomic<std::uint64_t>, error_codes> error_{};
+
+    template<class T>
+    static T info(easy_handle_t easy, CURLINFO what) noexcept
+    {
+        T rc = T();
+        if (curl_easy_getinfo(easy, what, &rc) != CURLE_OK)
+            return T();
+        return rc;
+    }
+
+    static std::uint64_t diff(curl_off_t a, curl_off_t b) noexcept
+    {
+        return (a > b) ? static_cast<std::uint64_t>(a - b) : 0;
+    }
+
+public:
+    void record(easy_handle_t easy, CURLcode code) noexcept
+    {
+        assert(easy);
+
+        constexpr auto relaxed = std::memory_order_relaxed;
+        requests_.fetch_add(1, relaxed);
+
+        if (code != CURLE_OK)
+        {
+            errors_.fetch_add(1, relaxed);
+            auto i = static_cast<std::size_t>(code);
+            error_[(i < error_codes) ? i : error_codes - 1].fetch_add(1, relaxed);
+        }
+
+        // все времена от начала запроса в микросекундах
+        auto dns = info<curl_off_t>(easy, CURLINFO_NAMELOOKUP_TIME_T);
+        auto conn = info<curl_off_t>(easy, CURLINFO_CONNECT_TIME_T);
+        auto app = info<curl_off_t>(easy, CURLINFO_APPCONNECT_TIME_T);
+        auto start = info<curl_off_t>(easy, CURLINFO_STARTTRANSFER_TIME_T);
+        auto total = info<curl_off_t>(easy, CURLINFO_TOTAL_TIME_T);
+
+        // повторно использованное соединение - фазы нулевые
+        auto num_connects = info<long>(easy, CURLINFO_NUM_CONNECTS);
+        if (num_connects > 0)
+        {
+            connects_.fetch_add(1, relaxed);
+            dns_.add(static_cast<std::uint64_t>(dns));
+            connect_.add(diff(conn, dns));
+            if (app > 0)
+                tls_.add(diff(app, conn));
+        }
+        else
+            reused_.fetch_add(1, relaxed);
+
+        if (start > 0)
+            ttfb_.add(static_cast<std::uint64_t>(start));
+        total_.add(static_cast<std::uint64_t>(total));
+
+        auto down = info<curl_off_t>(easy, CURLINFO_SIZE_DOWNLOAD_T);
+        auto up = info<curl_off_t>(easy, CURLINFO_SIZE_UPLOAD_T);
+        bytes_down_.fetch_add(static_cast<std::uint64_t>(down), relaxed);
+        bytes_up_.fetch_add(static_cast<std::uint64_t>(up), relaxed);
+    }
+
+    snapshot get() const noexcept
+    {
+        constexpr auto relaxed = std::memory_order_relaxed;
+
+        snapshot rc;
+        rc.dns = dns_.get();
+        rc.connect = connect_.get();
+        rc.tls = tls_.get();
+        rc.ttfb = ttfb_.get();
+        rc.total = total_.get();
+        rc.requests = requests_.load(relaxed);
+        rc.bytes_down = bytes_down_.load(relaxed);
+        rc.bytes_up = bytes_up_.load(relaxed);
+        rc.connects = connects_.load(relaxed);
+        rc.reused = reused_.load(relaxed);
+        rc.errors = errors_.load(relaxed);
+        for (std::size_t i = 0; i < error_codes; ++i)
+            rc.error[i] = error_[i].load(relaxed);
+        return rc;
+    }
+};
+
+// сборщик статистики для client
+// record вызывается из потока очереди клиента
+// snapshot можно вызывать из любого потока
+class telemetry
+{
+    using host_map = std::unordered_map<std::string,
+        std::unique_ptr<host_stat>>;
+
+    // мьютекс только на добавление хоста и снимок
+    // поиск идет без блокировки: писатель один - поток клиента
+    mutable std::mutex mutex_{};
+    host_map host_{};
+    // буфер ключа, без аллокаций после прогрева
+    std::string key_{};
+
+    host_stat& get(std::string_view host)
+    {
+        key_.assign(host.data(), host.size());
+        auto f = host_.find(key_);
+        if (f != host_.end())
+            return *f->second;
+
+        std::lock_guard<std::mutex> l(mutex_);
+        auto& ptr = host_[key_];
+        ptr.reset(new host_stat);
+        return *ptr;
+    }
+
+public:
+    telemetry() = default;
+
+    telemetry(const telemetry&) = delete;
+    telemetry& operator=(const telemetry&) = delete;
+
+    void record(easy_handle_t easy, CURLcode code) noexcept
+    {
+        assert(easy);
+
+        try
+        {
+            const char *url = nullptr;
+            curl_easy_getinfo(easy, CURLINFO_EFFECTIVE_URL, &url);
+            auto host = host_of((url) ? std::string_view(url) :
+                std::string_view());
+
+            get(host).record(easy, code);
+        }
+        catch (...)
+        {   }
+    }
+
+    // перцентиль полного времени запросов к host в микросекундах
+    // host в формате host_of, 0 - хост неизвестен или мало запросов
+    // вызывать из потока клиента
+    std::uint64_t percentile(std::string_view host, double p,
+        std::uint64_t min_count = 16) noexcept
+    {
+        try
+        {
+            key_.assign(host.data(), host.size());
+            auto f = host_.find(key_);
+            if (f == host_.end())
+                return 0;
+
+            auto total = f->second->get().total;
+            return (total.count < min_count) ? 0 : total.percentile(p);
+        }
+        catch (...)
+        {   }
+
+        return 0;
+    }
+
+    // хост по CURLINFO_EFFECTIVE_URL, годится только для выполненного запроса
+    std::uint64_t percentile(easy_handle_t easy, double p,
+        std::uint64_t min_count = 16) noexcept
+    {
+        assert(easy);
+
+        const char *url = nullptr;
+        curl_easy_getinfo(easy, CURLINFO_EFFECTIVE_URL, &url);
+        return percentile(host_of((url) ? std::string_view(url) :
+            std::string_view()), p, min_count);
+    }
+
+    std::vector<host_stat::snapshot> snapshot() const
+    {
+        std::vector<host_stat::snapshot> rc;
+
+        std::lock_guard<std::mutex> l(mutex_);
+        rc.reserve(host_.size());
+        for (auto& h : host_)
+        {
+            rc.push_back(h.second->get());
+            rc.back().host = h.first;
+        }
+
+        return rc;
+    }
+};
+
+} // namespace curl
+} // namespace btpro
@@ -0,0 +1,232 @@
+#pragma once
+
+#include "btpro/sock_addr.hpp"
+
+#include <random>
+#include <functional>
+
+namespace btpro {
+namespace ip {
+
+// компактный ключ адреса с портом для хэш-таблиц
+// 24 байта вместо 128 у sock_addr, сравнение и хэш по трем словам
+// ipv4 занимает первые 4 байта адреса, ipv4-mapped не приводится
+class endpoint_key
+{
+    std::uint8_t addr_[16]{};
+    std::uint16_t family_{};
+    // сетевой порядок
+    std::uint16_t port_{};
+    std::uint32_t scope_{};
+
+    std::uint64_t word(std::size_t i) const noexcept
+    {
+        std::uint64_t rc;
+        std::memcpy(&rc, reinterpret_cast<const char*>(this) + i * 8, sizeof(rc));
+        return rc;
+    }
+
+    static std::uint64_t fmix(std::uint64_t h) noexcept
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+public:
+    endpoint_key() = default;
+
+    endpoint_key(const sockaddr *sa, ev_socklen_t salen)
+    {
+        assert(sa);
+
+        if ((sa->sa_family == AF_INET) && (salen >= sizeof(sockaddr_in)))
+        {
+            auto sin = reinterpret_cast<const sockaddr_in*>(sa);
+            std::memcpy(addr_, &sin->sin_addr, sizeof(sin->sin_addr));
+            port_ = sin->sin_port;
+        }
+        else if ((sa->sa_family == AF_INET6) && (salen >= sizeof(sockaddr_in6)))
+        {
+            auto sin6 = reinterpret_cast<const sockaddr_in6*>(sa);
+            std::memcpy(addr_, &sin6->sin6_addr, sizeof(sin6->sin6_addr));
+            port_ = sin6->sin6_port;
+            scope_ = sin6->sin6_scope_id;
+        }
+        else
+            throw std::runtime_error("endpoint_key address family");
+
+        family_ = sa->sa_family;
+    }
+
+    endpoint_key(const ip::addr& addr)
+        : endpoint_key(addr.sa(), addr.size())
+    {   }
+
+    explicit endpoint_key(const in_addr& in, int port = 0) noexcept
+        : family_(AF_INET)
+        , port_(htons(static_cast<std::uint16_t>(port)))
+    {
+        assert((port >= 0) && (port < 65536));
+        std::memcpy(addr_, &in, sizeof(in));
+    }
+
+    explicit endpoint_key(const in6_addr& in, int port = 0) noexcept
+        : family_(AF_INET6)
+        , port_(htons(static_cast<std::uint16_t>(port)))
+    {
+        assert((port >= 0) && (port < 65536));
+        std::memcpy(addr_, &in, sizeof(in));
+    }
+
+    int family() const noexcept
+    {
+        return family_;
+    }
+
+    int port() const noexcept
+    {
+        return static_cast<int>(ntohs(port_));
+    }
+
+    std::uint32_t scope_id() const noexcept
+    {
+        return scope_;
+    }
+
+    // адрес в сетевом порядке, 4 или 16 байт
+    const std::uint8_t* data() const noexcept
+    {
+        return addr_;
+    }
+
+    bool empty() const noexcept
+    {
+        return !family_;
+    }
+
+    endpoint_key with_port(int port) const noexcept
+    {
+        assert((port >= 0) && (port < 65536));
+        auto rc = *this;
+        rc.port_ = htons(static_cast<std::uint16_t>(port));
+        return rc;
+    }
+
+    // ключ только по адресу, например для лимитов на хост
+    endpoint_key address() const noexcept
+    {
+        return with_port(0);
+    }
+
+    sock_addr to_sock_addr() const
+    {
+        if (family_ == AF_INET)
+        {
+            auto sin = ipv4::addr::create_sockaddr_in();
+            sin.sin_family = AF_INET;
+            sin.sin_port = port_;
+            std::memcpy(&sin.sin_addr, addr_, sizeof(sin.sin_addr));
+            return sock_addr(reinterpret_cast<const sockaddr*>(&sin), sizeof(sin));
+        }
+        else if (family_ == AF_INET6)
+        {
+            auto sin6 = ipv6::addr::create_sockaddr_in6();
+            sin6.sin6_family = AF_INET6;
+            sin6.sin6_port = port_;
+            sin6.sin6_scope_id = scope_;
+            std::memcpy(&sin6.sin6_addr, addr_, sizeof(sin6.sin6_addr));
+            return sock_addr(reinterpret_cast<const sockaddr*>(&sin6), sizeof(sin6));
+        }
+
+        return sock_addr();
+    }
+
+    // with_port - порт если задан, как в operator<< для sock_addr
+    std::to_chars_result to_chars(char *first, char *last,
+        bool with_port = false) const noexcept
+    {
+        if (family_ == AF_INET)
+        {
+            auto sin = ipv4::addr::create_sockaddr_in();
+            sin.sin_family = AF_INET;
+            sin.sin_port = port_;
+            std::memcpy(&sin.sin_addr, addr_, sizeof(sin.sin_addr));
+            return ipv4::addr(sin).to_chars(first, last, with_port);
+        }
+        else if (family_ == AF_INET6)
+        {
+            auto sin6 = ipv6::addr::create_sockaddr_in6();
+            sin6.sin6_family = AF_INET6;
+            sin6.sin6_port = port_;
+            std::memcpy(&sin6.sin6_addr, addr_, sizeof(sin6.sin6_addr));
+            return ipv6::addr(sin6).to_chars(first, last, with_port);
+        }
+
+        return { first, std::errc::address_family_not_supported };
+    }
+
+    // seed защищает таблицу от подобранных адресов
+    std::uint64_t hash(std::uint64_t seed = 0) const noexcept
+    {
+        auto h = seed ^ 0x9e3779b97f4a7c15ull;
+        h = fmix(h ^ word(0));
+        h = fmix(h ^ word(1));
+        return fmix(h ^ word(2));
+    }
+
+    // случайный seed процесса
+    static std::uint64_t process_seed() noexcept
+    {
+        static const std::uint64_t seed = [] {
+            try
+            {
+                std::random_device rd;
+                return (std::uint64_t{rd()} << 32) | rd();
+            }
+            catch (...)
+            {   }
+            return static_cast<std::uint64_t>(
+                std::chrono::steady_clock::now().time_since_epoch().count());
+        }();
+        return seed;
+    }
+
+    bool operator==(const endpoint_key& other) const noexcept
+    {
+        return (word(0) == other.word(0)) && (word(1) == other.word(1)) &&
+            (word(2) == other.word(2));
+    }
+
+    bool operator!=(const endpoint_key& other) const noexcept
+    {
+        return !(*this == other);
+    }
+
+    bool operator<(const endpoint_key& other) const noexcept
+    {
+        return std::memcmp(this, &other, sizeof(*this)) < 0;
+    }
+};
+
+static_assert(sizeof(endpoint_key) == 24, "endpoint_key size");
+
+} // namespace ip
+} // namespace btpro
+
+namespace std {
+
+template<>
+struct hash<btpro::ip::endpoint_key>
+{
+    std::size_t operator()(const btpro::ip::endpoint_key& key) const noexcept
+    {
+        return static_cast<std::size_t>(
+            key.hash(btpro::ip::endpoint_key::process_seed()));
+    }
+};
+
+} // namespace std
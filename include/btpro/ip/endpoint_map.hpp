@@ -0,0 +1,357 @@
+#pragma once
+
+#include "btpro/ip/endpoint_key.hpp"
+
+#include <vector>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace btpro {
+namespace ip {
+
+// хэш-таблица с открытой адресацией для endpoint_key
+// линейное пробирование, управляющие байты проверяются группами по 16
+// байт 0 - пустая ячейка, иначе 0x80 | старшие 7 бит хэша
+// удаление сдвигом назад, без надгробий
+// V должен иметь конструктор по умолчанию
+template<class V>
+class endpoint_map
+{
+public:
+    using key_type = endpoint_key;
+    using mapped_type = V;
+
+private:
+    constexpr static std::size_t group = 16;
+    constexpr static std::size_t npos = ~std::size_t{};
+
+    struct slot
+    {
+        endpoint_key key{};
+        V value{};
+    };
+
+    // ctrl_ длиннее на group, хвост повторяет начало для чтения группы
+    std::vector<std::uint8_t> ctrl_{};
+    std::vector<slot> slot_{};
+    std::size_t mask_{};
+    std::size_t size_{};
+    std::uint64_t seed_{endpoint_key::process_seed()};
+
+    std::uint64_t hash(const endpoint_key& key) const noexcept
+    {
+        return key.hash(seed_);
+    }
+
+    static std::uint8_t tag(std::uint64_t h) noexcept
+    {
+        return static_cast<std::uint8_t>((h >> 57) | 0x80);
+    }
+
+    void set_ctrl(std::size_t i, std::uint8_t c) noexcept
+    {
+        ctrl_[i] = c;
+        if (i < group)
+            ctrl_[mask_ + 1 + i] = c;
+    }
+
+    static unsigned ctz(unsigned x) noexcept
+    {
+        assert(x);
+#if defined(__GNUC__)
+        return static_cast<unsigned>(__builtin_ctz(x));
+#else
+        unsigned rc = 0;
+        while (!(x & 1))
+        {
+            x >>= 1;
+            ++rc;
+        }
+        return rc;
+#endif
+    }
+
+    // битовые маски совпавших с t и пустых байт группы с позиции pos
+    void match(std::size_t pos, std::uint8_t t,
+        unsigned& found, unsigned& empty) const noexcept
+    {
+        auto p = ctrl_.data() + pos;
+#if defined(__SSE2__)
+        auto g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        found = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(g, _mm_set1_epi8(static_cast<char>(t)))));
+        empty = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(g, _mm_setzero_si128())));
+#else
+        found = 0;
+        empty = 0;
+        for (std::size_t i = 0; i < group; ++i)
+        {
+            found |= unsigned{p[i] == t} << i;
+            empty |= unsigned{p[i] == 0} << i;
+        }
+#endif
+    }
+
+    // индекс ключа или npos, в ins - первая пустая ячейка цепочки
+    std::size_t lookup(const endpoint_key& key, std::uint64_t h,
+        std::size_t& ins) const noexcept
+    {
+        ins = npos;
+        if (slot_.empty())
+            return npos;
+
+        auto t = tag(h);
+        auto pos = static_cast<std::size_t>(h) & mask_;
+        while (true)
+        {
+            unsigned found, empty;
+            match(pos, t, found, empty);
+
+            // за пустой ячейкой цепочка кончилась
+            if (empty)
+                found &= (empty & (0u - empty)) - 1;
+
+            while (found)
+            {
+                auto i = (pos + ctz(found)) & mask_;
+                if (slot_[i].key == key)
+                    return i;
+                found &= found - 1;
+            }
+
+            if (empty)
+            {
+                ins = (pos + ctz(empty)) & mask_;
+                return npos;
+            }
+
+            pos = (pos + group) & mask_;
+        }
+    }
+
+    void rehash(std::size_t capacity)
+    {
+        std::vector<std::uint8_t> ctrl(capacity + group, 0);
+        std::vector<slot> slots(capacity);
+
+        ctrl_.swap(ctrl);
+        slot_.swap(slots);
+        mask_ = capacity - 1;
+
+        for (std::size_t i = 0; i < slots.size(); ++i)
+        {
+            if (!ctrl[i])
+                continue;
+
+            auto h = hash(slots[i].key);
+            std::size_t ins;
+            lookup(slots[i].key, h, ins);
+            assert(ins != npos);
+            set_ctrl(ins, tag(h));
+            slot_[ins] = std::move(slots[i]);
+        }
+    }
+
+    // заполнение не больше 3/4
+    void grow_for(std::size_t count)
+    {
+        auto capacity = slot_.size();
+        if (count * 4 <= capacity * 3)
+            return;
+
+        if (!capacity)
+            capacity = group;
+        while (count * 4 > capacity * 3)
+            capacity *= 2;
+
+        rehash(capacity);
+    }
+
+    // сдвигает назад элементы цепочки за удаленным i
+    void erase_at(std::size_t i) noexcept
+    {
+        auto j = i;
+        while (true)
+        {
+            j = (j + 1) & mask_;
+            if (!ctrl_[j])
+                break;
+
+            auto home = static_cast<std::size_t>(hash(slot_[j].key)) & mask_;
+            // home циклически в (i, j] - элемент остается на месте
+            bool stay = (i <= j) ? ((i < home) && (home <= j)) :
+                ((i < home) || (home <= j));
+            if (stay)
+                continue;
+
+            set_ctrl(i, ctrl_[j]);
+            slot_[i] = std::move(slot_[j]);
+            i = j;
+        }
+
+        set_ctrl(i, 0);
+        slot_[i] = slot();
+        --size_;
+    }
+
+    // первая пустая ячейка, обход от нее не встречает цепочку дважды
+    std::size_t first_empty() const noexcept
+    {
+        for (std::size_t i = 0; i <= mask_; ++i)
+        {
+            if (!ctrl_[i])
+                return i;
+        }
+        return 0;
+    }
+
+public:
+    endpoint_map() = default;
+
+    explicit endpoint_map(std::size_t count)
+    {
+        reserve(count);
+    }
+
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    bool empty() const noexcept
+    {
+        return !size_;
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return slot_.size();
+    }
+
+    void reserve(std::size_t count)
+    {
+        grow_for(count);
+    }
+
+    void clear() noexcept
+    {
+        std::fill(ctrl_.begin(), ctrl_.end(), std::uint8_t{});
+        for (auto& s : slot_)
+            s = slot();
+        size_ = 0;
+    }
+
+    V* find(const endpoint_key& key) noexcept
+    {
+        std::size_t ins;
+        auto i = lookup(key, hash(key), ins);
+        return (i != npos) ? &slot_[i].value : nullptr;
+    }
+
+    const V* find(const endpoint_key& key) const noexcept
+    {
+        std::size_t ins;
+        auto i = lookup(key, hash(key), ins);
+        return (i != npos) ? &slot_[i].value : nullptr;
+    }
+
+    bool contains(const endpoint_key& key) const noexcept
+    {
+        return find(key) != nullptr;
+    }
+
+    // second == true - вставлен новый элемент
+    // указатель действителен до следующей вставки или удаления
+    template<class... A>
+    std::pair<V*, bool> try_emplace(const endpoint_key& key, A&&... args)
+    {
+        auto h = hash(key);
+        std::size_t ins;
+        auto i = lookup(key, h, ins);
+        if (i != npos)
+            return { &slot_[i].value, false };
+
+        if ((size_ + 1) * 4 > slot_.size() * 3)
+        {
+            grow_for(size_ + 1);
+            lookup(key, h, ins);
+        }
+
+        assert(ins != npos);
+        slot_[ins].key = key;
+        slot_[ins].value = V(std::forward<A>(args)...);
+        set_ctrl(ins, tag(h));
+        ++size_;
+
+        return { &slot_[ins].value, true };
+    }
+
+    V& operator[](const endpoint_key& key)
+    {
+        return *try_emplace(key).first;
+    }
+
+    bool erase(const endpoint_key& key) noexcept
+    {
+        std::size_t ins;
+        auto i = lookup(key, hash(key), ins);
+        if (i == npos)
+            return false;
+
+        erase_at(i);
+        return true;
+    }
+
+    // fn(const endpoint_key&, V&)
+    template<class F>
+    void for_each(F fn)
+    {
+        if (!size_)
+            return;
+
+        auto start = first_empty();
+        for (std::size_t n = 1; n <= mask_; ++n)
+        {
+            auto i = (start + n) & mask_;
+            if (ctrl_[i])
+                fn(slot_[i].key, slot_[i].value);
+        }
+    }
+
+    // fn(const endpoint_key&, V&) -> true - удалить, например по ttl
+    // возвращает число удаленных
+    template<class F>
+    std::size_t erase_if(F fn)
+    {
+        if (!size_)
+            return 0;
+
+        std::size_t rc = 0;
+        auto start = first_empty();
+        for (std::size_t n = 1; n <= mask_; ++n)
+        {
+            auto i = (start + n) & mask_;
+            // на место удаленного сдвигается следующий, проверяем ячейку снова
+            while (ctrl_[i] && fn(slot_[i].key, slot_[i].value))
+            {
+                erase_at(i);
+                ++rc;
+            }
+        }
+
+        return rc;
+    }
+
+    // занятая память
+    std::size_t memory() const noexcept
+    {
+        return ctrl_.size() + slot_.size() * sizeof(slot);
+    }
+};
+
+} // namespace ip
+} // namespace btpro
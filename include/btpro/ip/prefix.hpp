@@ -0,0 +1,619 @@
+#pragma once
+
+#include "btpro/ip/text.hpp"
+#include "btpro/sock_addr.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace btpro {
+namespace ip {
+
+// префикс сети "10.0.0.0/8" или "2001:db8::/32"
+// биты за пределами длины обнуляются
+class prefix
+{
+    addr::sa_family family_{AF_UNSPEC};
+    std::uint8_t len_{};
+    std::uint8_t addr_[16]{};
+
+    void normalize() noexcept
+    {
+        auto bits = (family_ == AF_INET) ? 32u : 128u;
+        for (unsigned i = 0; i < bits / 8; ++i)
+        {
+            auto from = i * 8;
+            if (from >= len_)
+                addr_[i] = 0;
+            else if (from + 8 > len_)
+                addr_[i] &= static_cast<std::uint8_t>(0xff00 >> (len_ - from));
+        }
+    }
+
+public:
+    prefix() = default;
+
+    prefix(const in_addr& in, unsigned len)
+        : family_(AF_INET)
+        , len_(static_cast<std::uint8_t>(len))
+    {
+        if (len > 32)
+            throw std::runtime_error("ipv4 prefix length");
+        std::memcpy(addr_, &in, sizeof(in));
+        normalize();
+    }
+
+    prefix(const in6_addr& in, unsigned len)
+        : family_(AF_INET6)
+        , len_(static_cast<std::uint8_t>(len))
+    {
+        if (len > 128)
+            throw std::runtime_error("ipv6 prefix length");
+        std::memcpy(addr_, &in, sizeof(in));
+        normalize();
+    }
+
+    prefix(const ip::addr& addr, unsigned len)
+    {
+        auto fm = addr.family();
+        if (fm == AF_INET)
+            *this = prefix(reinterpret_cast<const sockaddr_in*>(addr.sa())->sin_addr, len);
+        else if (fm == AF_INET6)
+            *this = prefix(reinterpret_cast<const sockaddr_in6*>(addr.sa())->sin6_addr, len);
+        else
+            throw std::runtime_error("prefix address family");
+    }
+
+    explicit prefix(std::string_view text)
+    {
+        auto last = text.data() + text.size();
+        auto res = from_chars(text.data(), last);
+        if ((res.ec != std::errc()) || (res.ptr != last))
+            throw std::runtime_error("parse prefix: " + std::string(text));
+    }
+
+    // адрес без длины - префикс хоста /32 или /128
+    std::from_chars_result from_chars(const char *first,
+        const char *last) noexcept
+    {
+        in6_addr in6;
+        in_addr in;
+        unsigned max = 32;
+        auto res = ip::from_chars(first, last, in);
+        if (res.ec != std::errc())
+        {
+            res = ip::from_chars(first, last, in6);
+            if (res.ec != std::errc())
+                return res;
+            max = 128;
+        }
+
+        unsigned len = max;
+        if ((res.ptr != last) && (*res.ptr == '/'))
+        {
+            auto l = std::from_chars(res.ptr + 1, last, len);
+            if ((l.ec != std::errc()) || (len > max))
+                return { first, std::errc::invalid_argument };
+            res.ptr = l.ptr;
+        }
+
+        if (max == 32)
+            *this = prefix(in, len);
+        else
+            *this = prefix(in6, len);
+
+        return res;
+    }
+
+    addr::sa_family family() const noexcept
+    {
+        return family_;
+    }
+
+    unsigned length() const noexcept
+    {
+        return len_;
+    }
+
+    // адрес в сетевом порядке, 4 или 16 байт
+    const std::uint8_t* data() const noexcept
+    {
+        return addr_;
+    }
+
+    std::to_chars_result to_chars(char *first, char *last) const noexcept
+    {
+        std::to_chars_result res{ first, std::errc::address_family_not_supported };
+        if (family_ == AF_INET)
+        {
+            in_addr in;
+            std::memcpy(&in, addr_, sizeof(in));
+            res = ip::to_chars(first, last, in);
+        }
+        else if (family_ == AF_INET6)
+        {
+            in6_addr in6;
+            std::memcpy(&in6, addr_, sizeof(in6));
+            res = ip::to_chars(first, last, in6);
+        }
+
+        if (res.ec != std::errc())
+            return res;
+        if (res.ptr == last)
+            return { last, std::errc::value_too_large };
+
+        *res.ptr++ = '/';
+        return std::to_chars(res.ptr, last, unsigned{len_});
+    }
+
+    std::string to_string() const
+    {
+        char buf[64];
+        auto res = to_chars(buf, buf + sizeof(buf));
+        return (res.ec == std::errc()) ?
+            std::string(buf, static_cast<std::size_t>(res.ptr - buf)) :
+            std::string();
+    }
+};
+
+// таблица longest prefix match, после заполнения только читается
+// ipv4 - DIR-16-8-8: корень на 2^16 записей и блоки по 256
+// не больше трех обращений к памяти на поиск
+// ipv6 - бинарное дерево со сжатием путей, узлы в одном векторе
+// ipv4-mapped адреса ищутся в таблице ipv4
+template<class T>
+class lpm_table
+{
+    // запись ipv4: 0 - пусто, старший бит - номер блока, иначе значение + 1
+    constexpr static std::uint32_t chunk_bit = 0x80000000u;
+
+    struct leaf4
+    {
+        std::uint32_t entry;
+        // длина префикса, записавшего ячейку
+        std::uint8_t len;
+    };
+
+    struct node6
+    {
+        std::uint64_t hi{};
+        std::uint64_t lo{};
+        std::uint32_t child[2]{};
+        std::int32_t value{-1};
+        std::uint8_t len{};
+    };
+
+    // обертка, чтобы vector<bool> не отдавал прокси вместо ссылки
+    struct value_type
+    {
+        T value;
+    };
+
+    std::vector<value_type> value_{};
+    std::vector<leaf4> root4_{};
+    std::vector<leaf4> chunk4_{};
+    std::vector<node6> node6_{};
+    std::size_t size4_{};
+    std::size_t size6_{};
+
+    static std::uint64_t load64(const std::uint8_t *p) noexcept
+    {
+        std::uint64_t rc = 0;
+        for (int i = 0; i < 8; ++i)
+            rc = (rc << 8) | p[i];
+        return rc;
+    }
+
+    static std::uint32_t load32(const std::uint8_t *p) noexcept
+    {
+        return (std::uint32_t{p[0]} << 24) | (std::uint32_t{p[1]} << 16) |
+            (std::uint32_t{p[2]} << 8) | p[3];
+    }
+
+    static unsigned bit6(std::uint64_t hi, std::uint64_t lo, unsigned i) noexcept
+    {
+        return (i < 64) ? static_cast<unsigned>((hi >> (63 - i)) & 1) :
+            static_cast<unsigned>((lo >> (127 - i)) & 1);
+    }
+
+    static unsigned clz64(std::uint64_t x) noexcept
+    {
+        assert(x);
+#if defined(__GNUC__)
+        return static_cast<unsigned>(__builtin_clzll(x));
+#else
+        unsigned rc = 0;
+        while (!(x & (std::uint64_t{1} << 63)))
+        {
+            x <<= 1;
+            ++rc;
+        }
+        return rc;
+#endif
+    }
+
+    static std::uint64_t mask64(unsigned len) noexcept
+    {
+        return (len >= 64) ? ~std::uint64_t{} :
+            (len) ? ~std::uint64_t{} << (64 - len) : 0;
+    }
+
+    // общая длина префикса a и b, не больше max
+    static unsigned common6(std::uint64_t ahi, std::uint64_t alo,
+        std::uint64_t bhi, std::uint64_t blo, unsigned max) noexcept
+    {
+        unsigned rc = 128;
+        if (auto x = ahi ^ bhi)
+            rc = clz64(x);
+        else if (auto y = alo ^ blo)
+            rc = 64 + clz64(y);
+        return (std::min)(rc, max);
+    }
+
+    static bool match6(const node6& n, std::uint64_t hi, std::uint64_t lo) noexcept
+    {
+        return (((hi ^ n.hi) & mask64(n.len)) == 0) &&
+            ((n.len <= 64) || (((lo ^ n.lo) & mask64(n.len - 64)) == 0));
+    }
+
+    std::uint32_t new_chunk(leaf4 fill)
+    {
+        auto index = chunk4_.size() / 256;
+        if (index >= chunk_bit)
+            throw std::runtime_error("lpm ipv4 chunks");
+        chunk4_.resize(chunk4_.size() + 256, fill);
+        return static_cast<std::uint32_t>(index) | chunk_bit;
+    }
+
+    // заполняет count ячеек уровня, более длинные префиксы не трогаем
+    void fill4(leaf4 *cell, std::size_t count, leaf4 leaf) noexcept
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto& c = cell[i];
+            if (c.entry & chunk_bit)
+            {
+                auto base = (c.entry & ~chunk_bit) * std::size_t{256};
+                fill4(chunk4_.data() + base, 256, leaf);
+            }
+            else if (c.len <= leaf.len)
+                c = leaf;
+        }
+    }
+
+    void insert4(std::uint32_t addr, unsigned len, std::uint32_t entry)
+    {
+        leaf4 leaf{ entry, static_cast<std::uint8_t>(len) };
+
+        if (root4_.empty())
+            root4_.assign(std::size_t{1} << 16, leaf4{ 0, 0 });
+
+        if (len <= 16)
+        {
+            auto from = addr >> 16;
+            fill4(root4_.data() + from, std::size_t{1} << (16 - len), leaf);
+            return;
+        }
+
+        // спуск до блока нужного уровня, листья по пути опускаются в блок
+        auto slot = [&](std::vector<leaf4>& level, std::size_t i) {
+            auto c = level[i];
+            if (!(c.entry & chunk_bit))
+            {
+                auto chunk = new_chunk(c);
+                level[i].entry = chunk;
+                level[i].len = 0;
+                return static_cast<std::size_t>(chunk & ~chunk_bit) * 256;
+            }
+            return static_cast<std::size_t>(c.entry & ~chunk_bit) * 256;
+        };
+
+        auto base = slot(root4_, addr >> 16);
+        if (len <= 24)
+        {
+            auto from = base + ((addr >> 8) & 0xff);
+            fill4(chunk4_.data() + from, std::size_t{1} << (24 - len), leaf);
+            return;
+        }
+
+        base = slot(chunk4_, base + ((addr >> 8) & 0xff));
+        auto from = base + (addr & 0xff);
+        fill4(chunk4_.data() + from, std::size_t{1} << (32 - len), leaf);
+    }
+
+    void insert6(std::uint64_t hi, std::uint64_t lo, unsigned len,
+        std::int32_t value)
+    {
+        if (node6_.empty())
+            node6_.emplace_back();
+
+        std::uint32_t n = 0;
+        while (true)
+        {
+            if (len == node6_[n].len)
+            {
+                node6_[n].value = value;
+                return;
+            }
+
+            auto b = bit6(hi, lo, node6_[n].len);
+            auto c = node6_[n].child[b];
+
+            node6 leaf;
+            leaf.hi = hi;
+            leaf.lo = lo;
+            leaf.len = static_cast<std::uint8_t>(len);
+            leaf.value = value;
+
+            if (!c)
+            {
+                node6_.push_back(leaf);
+                node6_[n].child[b] = static_cast<std::uint32_t>(node6_.size() - 1);
+                return;
+            }
+
+            auto& m = node6_[c];
+            auto common = common6(hi, lo, m.hi, m.lo, (std::min)(len, unsigned{m.len}));
+            if (common == m.len)
+            {
+                n = c;
+                continue;
+            }
+
+            auto mb = bit6(m.hi, m.lo, common);
+            if (common == len)
+            {
+                // новый префикс короче узла и покрывает его
+                leaf.child[mb] = c;
+                node6_.push_back(leaf);
+            }
+            else
+            {
+                // развилка на первом различающемся бите
+                node6 fork;
+                fork.hi = hi & mask64(common);
+                fork.lo = (common > 64) ? lo & mask64(common - 64) : 0;
+                fork.len = static_cast<std::uint8_t>(common);
+                fork.child[mb] = c;
+                node6_.push_back(leaf);
+                fork.child[mb ^ 1] = static_cast<std::uint32_t>(node6_.size() - 1);
+                node6_.push_back(fork);
+            }
+
+            node6_[n].child[b] = static_cast<std::uint32_t>(node6_.size() - 1);
+            return;
+        }
+    }
+
+    const T* find4(std::uint32_t addr) const noexcept
+    {
+        if (root4_.empty())
+            return nullptr;
+
+        auto e = root4_[addr >> 16].entry;
+        if (e & chunk_bit)
+        {
+            e = chunk4_[(e & ~chunk_bit) * std::size_t{256} + ((addr >> 8) & 0xff)].entry;
+            if (e & chunk_bit)
+                e = chunk4_[(e & ~chunk_bit) * std::size_t{256} + (addr & 0xff)].entry;
+        }
+
+        return (e) ? &value_[e - 1].value : nullptr;
+    }
+
+    const T* find6(std::uint64_t hi, std::uint64_t lo) const noexcept
+    {
+        if (node6_.empty())
+            return nullptr;
+
+        std::int32_t best = node6_[0].value;
+        std::uint32_t n = 0;
+        while (node6_[n].len < 128)
+        {
+            auto c = node6_[n].child[bit6(hi, lo, node6_[n].len)];
+            if (!c)
+                break;
+
+            auto& m = node6_[c];
+            if (!match6(m, hi, lo))
+                break;
+            if (m.value >= 0)
+                best = m.value;
+            n = c;
+        }
+
+        return (best >= 0) ? &value_[static_cast<std::size_t>(best)].value : nullptr;
+    }
+
+public:
+    lpm_table() = default;
+
+    // повторная вставка того же префикса заменяет значение
+    // префиксы можно добавлять в любом порядке
+    void insert(const prefix& p, T value)
+    {
+        if (value_.size() >= 0x7fffffffu)
+            throw std::runtime_error("lpm values");
+
+        auto fm = p.family();
+        if (fm == AF_INET)
+        {
+            value_.push_back(value_type{ std::move(value) });
+            insert4(load32(p.data()), p.length(),
+                static_cast<std::uint32_t>(value_.size()));
+            ++size4_;
+        }
+        else if (fm == AF_INET6)
+        {
+            value_.push_back(value_type{ std::move(value) });
+            insert6(load64(p.data()), load64(p.data() + 8), p.length(),
+                static_cast<std::int32_t>(value_.size() - 1));
+            ++size6_;
+        }
+        else
+            throw std::runtime_error("lpm address family");
+    }
+
+    void insert(std::string_view text, T value)
+    {
+        insert(prefix(text), std::move(value));
+    }
+
+    // nullptr - ни один префикс не покрывает адрес
+    const T* find(const in_addr& in) const noexcept
+    {
+        return find4(load32(reinterpret_cast<const std::uint8_t*>(&in)));
+    }
+
+    const T* find(const in6_addr& in) const noexcept
+    {
+        auto b = reinterpret_cast<const std::uint8_t*>(&in);
+        if (IN6_IS_ADDR_V4MAPPED(&in))
+            return find4(load32(b + 12));
+        return find6(load64(b), load64(b + 8));
+    }
+
+    const T* find(const ip::addr& addr) const noexcept
+    {
+        auto fm = addr.family();
+        if (fm == AF_INET)
+            return find(reinterpret_cast<const sockaddr_in*>(addr.sa())->sin_addr);
+        if (fm == AF_INET6)
+            return find(reinterpret_cast<const sockaddr_in6*>(addr.sa())->sin6_addr);
+        return nullptr;
+    }
+
+    // число вставок
+    std::size_t size() const noexcept
+    {
+        return size4_ + size6_;
+    }
+
+    bool empty() const noexcept
+    {
+        return !size();
+    }
+
+    // занятая память без учета значений
+    std::size_t memory() const noexcept
+    {
+        return (root4_.size() + chunk4_.size()) * sizeof(leaf4) +
+            node6_.size() * sizeof(node6);
+    }
+};
+
+// текущая lpm_table с чтением без блокировок
+// update публикует новую таблицу атомарной заменой указателя
+// и освобождает старую после выхода всех читателей, начавших до замены
+// читатели не ждут никогда, ждет только update
+template<class T>
+class lpm
+{
+    using table_type = lpm_table<T>;
+
+    std::atomic<const table_type*> table_{nullptr};
+    std::atomic<unsigned> epoch_{};
+    // читатели по четности эпохи
+    mutable std::atomic<std::uint64_t> readers_[2]{};
+
+    class read_guard
+    {
+        const lpm& self_;
+        unsigned slot_;
+
+    public:
+        read_guard(const lpm& self) noexcept
+            : self_(self)
+            , slot_(self.epoch_.load() & 1)
+        {
+            self_.readers_[slot_].fetch_add(1);
+        }
+
+        ~read_guard() noexcept
+        {
+            self_.readers_[slot_].fetch_sub(1, std::memory_order_release);
+        }
+    };
+
+    // читатель мог взять четность до прошлой смены эпохи
+    // поэтому ждем оба счетчика, каждый после своей смены
+    void synchronize() noexcept
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            auto old = epoch_.fetch_add(1) & 1;
+            while (readers_[old].load())
+                std::this_thread::yield();
+        }
+    }
+
+public:
+    lpm() = default;
+
+    explicit lpm(table_type table)
+        : table_(new table_type(std::move(table)))
+    {   }
+
+    lpm(const lpm&) = delete;
+    lpm& operator=(const lpm&) = delete;
+
+    ~lpm() noexcept
+    {
+        delete table_.load();
+    }
+
+    // вызывать из одного потока
+    void update(table_type table)
+    {
+        std::unique_ptr<const table_type> next(new table_type(std::move(table)));
+        std::unique_ptr<const table_type> prev(table_.exchange(next.release()));
+        synchronize();
+    }
+
+    // fn(const lpm_table<T>*) под защитой от освобождения
+    // указатель нельзя сохранять после выхода из fn
+    template<class F>
+    auto read(F fn) const
+    {
+        read_guard guard(*this);
+        return fn(table_.load());
+    }
+
+    // копия значения самого длинного подходящего префикса
+    template<class A>
+    bool find(const A& addr, T& out) const
+    {
+        return read([&](const table_type *table) {
+            if (!table)
+                return false;
+            auto value = table->find(addr);
+            if (!value)
+                return false;
+            out = *value;
+            return true;
+        });
+    }
+
+    // true - адрес разрешен
+    // значение префикса true - разрешить, false - запретить
+    // def - для адресов вне таблицы
+    template<class A>
+    bool allow(const A& addr, bool def = true) const noexcept
+    {
+        static_assert(std::is_convertible<T, bool>::value,
+            "lpm value must be convertible to bool");
+
+        return read([&](const table_type *table) noexcept {
+            if (!table)
+                return def;
+            auto value = table->find(addr);
+            return (value) ? static_cast<bool>(*value) : def;
+        });
+    }
+};
+
+} // namespace ip
+} // namespace btpro
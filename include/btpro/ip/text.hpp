@@ -0,0 +1,426 @@
+#pragma once
+
+#include "btpro/btpro.hpp"
+
+#include <charconv>
+#include <string_view>
+#include <system_error>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace btpro {
+namespace ip {
+
+// разбор и печать адресов без аллокаций и без inet_pton/inet_ntop
+// from_chars: ptr - первый неразобранный символ, при ошибке ptr == first
+// to_chars: при нехватке места ec == errc::value_too_large
+
+namespace detail {
+
+static inline bool is_digit(char c) noexcept
+{
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+static inline int hex_value(char c) noexcept
+{
+    if (is_digit(c))
+        return c - '0';
+    auto l = static_cast<unsigned char>(c | 0x20);
+    if ((l >= 'a') && (l <= 'f'))
+        return l - 'a' + 10;
+    return -1;
+}
+
+// как inet_pton: ровно 4 октета, без ведущих нулей
+static inline const char* parse_quad(const char *first, const char *last,
+    std::uint8_t *out) noexcept
+{
+    auto p = first;
+    for (int i = 0; i < 4; ++i)
+    {
+        if (i)
+        {
+            if ((p == last) || (*p != '.'))
+                return nullptr;
+            ++p;
+        }
+
+        if ((p == last) || !is_digit(*p))
+            return nullptr;
+
+        unsigned v = static_cast<unsigned>(*p++ - '0');
+        if (!v && (p != last) && is_digit(*p))
+            return nullptr;
+
+        while ((p != last) && is_digit(*p))
+        {
+            v = v * 10 + static_cast<unsigned>(*p++ - '0');
+            if (v > 255)
+                return nullptr;
+        }
+
+        out[i] = static_cast<std::uint8_t>(v);
+    }
+
+    return p;
+}
+
+#if defined(__SSSE3__)
+// раскладка цифр октетов по 4 байта [0, сотни, десятки, единицы]
+// индекс - длины октетов (l0 - 1) * 27 + (l1 - 1) * 9 + (l2 - 1) * 3 + (l3 - 1)
+struct quad_shuffle
+{
+    std::uint8_t mask[81][16]{};
+
+    constexpr quad_shuffle() noexcept
+    {
+        for (int i = 0; i < 81; ++i)
+        {
+            int len[4] = { i / 27 + 1, (i / 9) % 3 + 1, (i / 3) % 3 + 1, i % 3 + 1 };
+            int pos = 0;
+            for (int f = 0; f < 4; ++f)
+            {
+                for (int j = 0; j < 4; ++j)
+                {
+                    int k = j - (4 - len[f]);
+                    mask[i][f * 4 + j] = (k < 0) ? 0x80 :
+                        static_cast<std::uint8_t>(pos + k);
+                }
+                pos += len[f] + 1;
+            }
+        }
+    }
+};
+
+// классификация 16 байт за раз, октеты собираются pshufb + pmaddubsw
+// false - не уложились в быстрый путь, разбирать скалярно
+static inline bool parse_quad_simd(const char *first, const char *last,
+    std::uint8_t *out, const char*& end) noexcept
+{
+    static constexpr quad_shuffle shuffle{};
+
+    // короткий хвост копируем, чтобы не читать за пределами строки
+    alignas(16) char buf[16];
+    auto src = first;
+    auto size = static_cast<std::size_t>(last - first);
+    if (size < sizeof(buf))
+    {
+        std::memset(buf, 0, sizeof(buf));
+        std::memcpy(buf, first, size);
+        src = buf;
+    }
+
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    auto d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    auto digit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    auto dot = _mm_cmpeq_epi8(v, _mm_set1_epi8('.'));
+
+    auto digit_bits = static_cast<unsigned>(_mm_movemask_epi8(digit));
+    auto dot_bits = static_cast<unsigned>(_mm_movemask_epi8(dot));
+    auto other = ~(digit_bits | dot_bits) & 0xffffu;
+    if (!other)
+        return false;
+
+    auto len = static_cast<unsigned>(__builtin_ctz(other));
+    dot_bits &= (1u << len) - 1;
+    if (__builtin_popcount(dot_bits) != 3)
+        return false;
+
+    unsigned d0 = static_cast<unsigned>(__builtin_ctz(dot_bits));
+    dot_bits &= dot_bits - 1;
+    unsigned d1 = static_cast<unsigned>(__builtin_ctz(dot_bits));
+    dot_bits &= dot_bits - 1;
+    unsigned d2 = static_cast<unsigned>(__builtin_ctz(dot_bits));
+
+    unsigned l[4] = { d0, d1 - d0 - 1, d2 - d1 - 1, len - d2 - 1 };
+    unsigned start[4] = { 0, d0 + 1, d1 + 1, d2 + 1 };
+    for (int i = 0; i < 4; ++i)
+    {
+        // пустой октет дает переполнение до большого unsigned
+        if (l[i] - 1 > 2)
+            return false;
+        if ((l[i] > 1) && (src[start[i]] == '0'))
+            return false;
+    }
+
+    auto index = (l[0] - 1) * 27 + (l[1] - 1) * 9 + (l[2] - 1) * 3 + (l[3] - 1);
+    auto mask = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(shuffle.mask[index]));
+    auto g = _mm_shuffle_epi8(d, mask);
+    auto w = _mm_setr_epi8(0, 100, 10, 1, 0, 100, 10, 1,
+        0, 100, 10, 1, 0, 100, 10, 1);
+    auto sum = _mm_madd_epi16(_mm_maddubs_epi16(g, w), _mm_set1_epi16(1));
+
+    alignas(16) std::uint32_t octet[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(octet), sum);
+    if ((octet[0] | octet[1] | octet[2] | octet[3]) > 255)
+        return false;
+
+    for (int i = 0; i < 4; ++i)
+        out[i] = static_cast<std::uint8_t>(octet[i]);
+
+    end = first + len;
+    return true;
+}
+#endif // __SSSE3__
+
+static inline char* put_octet(char *p, unsigned v) noexcept
+{
+    if (v >= 100)
+    {
+        *p++ = static_cast<char>('0' + v / 100);
+        v %= 100;
+        *p++ = static_cast<char>('0' + v / 10);
+    }
+    else if (v >= 10)
+        *p++ = static_cast<char>('0' + v / 10);
+    *p++ = static_cast<char>('0' + v % 10);
+    return p;
+}
+
+static inline char* put_quad(char *p, const std::uint8_t *in) noexcept
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        if (i)
+            *p++ = '.';
+        p = put_octet(p, in[i]);
+    }
+    return p;
+}
+
+static inline std::to_chars_result copy_out(char *first, char *last,
+    const char *buf, std::size_t size) noexcept
+{
+    if (static_cast<std::size_t>(last - first) < size)
+        return { last, std::errc::value_too_large };
+    std::memcpy(first, buf, size);
+    return { first + size, std::errc() };
+}
+
+} // namespace detail
+
+// "a.b.c.d"
+static inline std::from_chars_result from_chars(const char *first,
+    const char *last, in_addr& out) noexcept
+{
+    assert(first <= last);
+
+    std::uint8_t b[4];
+    const char *end = nullptr;
+#if defined(__SSSE3__)
+    if (!detail::parse_quad_simd(first, last, b, end))
+        end = detail::parse_quad(first, last, b);
+#else
+    end = detail::parse_quad(first, last, b);
+#endif
+
+    if (!end)
+        return { first, std::errc::invalid_argument };
+
+    std::memcpy(&out, b, sizeof(b));
+    return { end, std::errc() };
+}
+
+// rfc 4291, вместе с "::" и ipv4 в последних 32 битах
+static inline std::from_chars_result from_chars(const char *first,
+    const char *last, in6_addr& out) noexcept
+{
+    assert(first <= last);
+
+    constexpr auto fail = std::errc::invalid_argument;
+
+    std::uint8_t tmp[16]{};
+    std::uint8_t *tp = tmp;
+    std::uint8_t *endp = tmp + sizeof(tmp);
+    std::uint8_t *colonp = nullptr;
+
+    auto p = first;
+    if ((p != last) && (*p == ':'))
+    {
+        if ((++p == last) || (*p != ':'))
+            return { first, fail };
+    }
+
+    auto curtok = p;
+    unsigned val = 0;
+    int digits = 0;
+    while (p != last)
+    {
+        auto ch = *p;
+        auto h = detail::hex_value(ch);
+        if (h >= 0)
+        {
+            if (++digits > 4)
+                return { first, fail };
+            val = (val << 4) | static_cast<unsigned>(h);
+            ++p;
+            continue;
+        }
+
+        if (ch == ':')
+        {
+            curtok = ++p;
+            if (!digits)
+            {
+                if (colonp)
+                    return { first, fail };
+                colonp = tp;
+                continue;
+            }
+
+            // после группы - следующая группа или "::"
+            if ((p == last) || ((detail::hex_value(*p) < 0) && (*p != ':')))
+                return { first, fail };
+            if (tp + 2 > endp)
+                return { first, fail };
+
+            *tp++ = static_cast<std::uint8_t>(val >> 8);
+            *tp++ = static_cast<std::uint8_t>(val);
+            digits = 0;
+            val = 0;
+            continue;
+        }
+
+        if ((ch == '.') && (tp + 4 <= endp))
+        {
+            p = detail::parse_quad(curtok, last, tp);
+            if (!p)
+                return { first, fail };
+            tp += 4;
+            digits = 0;
+        }
+
+        break;
+    }
+
+    if (digits)
+    {
+        if (tp + 2 > endp)
+            return { first, fail };
+        *tp++ = static_cast<std::uint8_t>(val >> 8);
+        *tp++ = static_cast<std::uint8_t>(val);
+    }
+
+    if (colonp)
+    {
+        if (tp == endp)
+            return { first, fail };
+
+        auto n = static_cast<std::size_t>(tp - colonp);
+        std::memmove(endp - n, colonp, n);
+        std::memset(colonp, 0, static_cast<std::size_t>(endp - n - colonp));
+        tp = endp;
+    }
+
+    if (tp != endp)
+        return { first, fail };
+
+    std::memcpy(&out, tmp, sizeof(tmp));
+    return { p, std::errc() };
+}
+
+// десятичный порт 0..65535
+static inline std::from_chars_result port_from_chars(const char *first,
+    const char *last, int& port) noexcept
+{
+    unsigned v = 0;
+    auto res = std::from_chars(first, last, v);
+    if (res.ec != std::errc())
+        return { first, res.ec };
+    if (v > 65535)
+        return { first, std::errc::result_out_of_range };
+
+    port = static_cast<int>(v);
+    return res;
+}
+
+static inline std::to_chars_result to_chars(char *first, char *last,
+    const in_addr& in) noexcept
+{
+    char buf[16];
+    auto e = detail::put_quad(buf, reinterpret_cast<const std::uint8_t*>(&in));
+    return detail::copy_out(first, last, buf, static_cast<std::size_t>(e - buf));
+}
+
+// как inet_ntop: rfc 5952, ipv4-mapped и ipv4-compatible с точками
+static inline std::to_chars_result to_chars(char *first, char *last,
+    const in6_addr& in) noexcept
+{
+    static const char hex[] = "0123456789abcdef";
+
+    auto b = reinterpret_cast<const std::uint8_t*>(&in);
+    unsigned words[8];
+    for (int i = 0; i < 8; ++i)
+        words[i] = (unsigned{b[i * 2]} << 8) | b[i * 2 + 1];
+
+    // самая длинная серия нулевых групп, одну группу не сокращаем
+    int best = -1, best_len = 0;
+    for (int i = 0; i < 8;)
+    {
+        if (words[i])
+        {
+            ++i;
+            continue;
+        }
+        int j = i;
+        while ((j < 8) && !words[j])
+            ++j;
+        if (j - i > best_len)
+        {
+            best = i;
+            best_len = j - i;
+        }
+        i = j;
+    }
+    if (best_len < 2)
+        best = -1;
+
+    char buf[48];
+    auto p = buf;
+    for (int i = 0; i < 8; ++i)
+    {
+        if ((best >= 0) && (i >= best) && (i < best + best_len))
+        {
+            if (i == best)
+                *p++ = ':';
+            continue;
+        }
+
+        if (i)
+            *p++ = ':';
+
+        if ((i == 6) && (best == 0) &&
+            ((best_len == 6) || ((best_len == 5) && (words[5] == 0xffff))))
+        {
+            p = detail::put_quad(p, b + 12);
+            break;
+        }
+
+        // без ведущих нулей
+        auto w = words[i];
+        int s = 12;
+        while (s && !((w >> s) & 0xf))
+            s -= 4;
+        for (; s >= 0; s -= 4)
+            *p++ = hex[(w >> s) & 0xf];
+    }
+
+    if ((best >= 0) && (best + best_len == 8))
+        *p++ = ':';
+
+    return detail::copy_out(first, last, buf, static_cast<std::size_t>(p - buf));
+}
+
+static inline std::to_chars_result port_to_chars(char *first, char *last,
+    int port) noexcept
+{
+    assert((port >= 0) && (port < 65536));
+    return std::to_chars(first, last, port);
+}
+
+} // namespace ip
+} // namespace btpro
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "btpro/ip/addr.hpp"
+#include "btpro/ip/text.hpp"
 #include "btdef/text.hpp"
 
 namespace btpro {
@@ -30,26 +31,26 @@ public:
 private:
     sockaddr_in sockaddr_in_ = empty_sockaddr_in();
 
-    static inline std::string parse(const std::string& str, int& port)
+    // "a.b.c.d" или "a.b.c.d:port"
+    static inline std::from_chars_result parse(const char *first,
+        const char *last, sockaddr_in& sin) noexcept
     {
-        if (str.empty())
-            return str;
+        sin = empty_sockaddr_in();
+        sin.sin_family = AF_INET;
 
-        auto f = str.rfind(':');
-        if (f != std::string::npos)
+        auto res = ip::from_chars(first, last, sin.sin_addr);
+        if ((res.ec == std::errc()) && (res.ptr != last) && (*res.ptr == ':'))
         {
-            if (!port)
-            {
-                // чтобы не копировать строку
-                auto port_str = std::string_view(str).substr(f + 1);
-                if (!port_str.empty())
-                    port = std::atoi(port_str.data());
-            }
-
-            return str.substr(0, f);
+            int port = 0;
+            auto p = ip::port_from_chars(res.ptr + 1, last, port);
+            if (p.ec != std::errc())
+                return { first, p.ec };
+
+            sin.sin_port = htons(static_cast<port_type>(port));
+            res.ptr = p.ptr;
         }
 
-        return str;
+        return res;
     }
 
     sockaddr* selfaddr() noexcept
@@ -128,20 +129,34 @@ public:
     {
         assert((port >= 0) && (port < 65536));
 
-        auto sin = empty_sockaddr_in();
-        sin.sin_family = AF_INET;
-        auto addr_str = parse(str, port);
-        auto res = inet_pton(AF_INET, addr_str.c_str(), &sin.sin_addr);
-        if (code::fail == res)
-            throw std::system_error(net::error_code(), addr_str);
-        if (1 != res)
-            throw std::runtime_error("inet_pton");
+        sockaddr_in sin;
+        auto last = str.data() + str.size();
+        auto res = parse(str.data(), last, sin);
+        if ((res.ec != std::errc()) || (res.ptr != last))
+            throw std::runtime_error("parse ipv4: " + str);
         if (port)
             sin.sin_port = htons(static_cast<port_type>(port));
 
         assign(sin);
     }
 
+    // без аллокаций, ptr - первый неразобранный символ
+    // при ошибке адрес не меняется
+    std::from_chars_result from_chars(const char *first,
+        const char *last) noexcept
+    {
+        sockaddr_in sin;
+        auto res = parse(first, last, sin);
+        if (res.ec == std::errc())
+            assign(sin);
+        return res;
+    }
+
+    std::from_chars_result from_chars(std::string_view text) noexcept
+    {
+        return from_chars(text.data(), text.data() + text.size());
+    }
+
     void assign(in_addr_t in_addr, int port = 0) noexcept
     {
         assert((port >= 0) && (port < 65536));
@@ -179,6 +194,22 @@ public:
         return static_cast<int>(ntohs(sockaddr_in_.sin_port));
     }
 
+    // with_port - ":port" если порт задан, как в operator<<
+    std::to_chars_result to_chars(char *first, char *last,
+        bool with_port = false) const noexcept
+    {
+        auto res = ip::to_chars(first, last, sockaddr_in_.sin_addr);
+        auto p = port();
+        if ((res.ec != std::errc()) || !with_port || !p)
+            return res;
+
+        if (res.ptr == last)
+            return { last, std::errc::value_too_large };
+
+        *res.ptr = ':';
+        return ip::port_to_chars(res.ptr + 1, last, p);
+    }
+
 private:
     template<class T>
     struct print
@@ -187,10 +218,10 @@ private:
         {
             T str;
             str.reserve(32);
-            auto res = inet_ntop(sa.family(), &sa->sin_addr,
-                str.data(), static_cast<ev_socklen_t>(str.capacity()));
-            if (res)
-                str.resize(std::strlen(res));
+            auto ptr = str.data();
+            auto res = sa.to_chars(ptr, ptr + str.capacity());
+            str.resize((res.ec == std::errc()) ?
+                static_cast<std::size_t>(res.ptr - ptr) : 0);
             return str;
         }
     };
@@ -204,8 +235,9 @@ public:
 
     std::string to_string() const
     {
-        btdef::util::text text = to_text();
-        return std::string(text.data(), text.size());
+        char buf[capacity];
+        auto res = to_chars(buf, buf + sizeof(buf));
+        return std::string(buf, static_cast<std::size_t>(res.ptr - buf));
     }
 };
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "btpro/ip/addr.hpp"
+#include "btpro/ip/text.hpp"
 #include "btdef/text.hpp"
 
 namespace btpro {
@@ -30,36 +31,36 @@ public:
 private:
     sockaddr_in6 sockaddr_in6_ = empty_sockaddr_in6();
 
-    static inline std::string parse(const std::string& str, int& port)
+    // "addr", "[addr]" или "[addr]:port"
+    static inline std::from_chars_result parse(const char *first,
+        const char *last, sockaddr_in6& sin6) noexcept
     {
-        if (str.empty())
-            return str;
+        sin6 = empty_sockaddr_in6();
+        sin6.sin6_family = AF_INET6;
+
+        // без скобок порта нет
+        if ((first == last) || (*first != '['))
+            return ip::from_chars(first, last, sin6.sin6_addr);
 
-        // если начинается со скобки
-        if (str.front() == '[')
+        auto res = ip::from_chars(first + 1, last, sin6.sin6_addr);
+        if (res.ec != std::errc())
+            return { first, res.ec };
+        if ((res.ptr == last) || (*res.ptr != ']'))
+            return { first, std::errc::invalid_argument };
+
+        res.ptr++;
+        if ((res.ptr != last) && (*res.ptr == ':'))
         {
-            // находим закрывающую скобку
-            auto e = str.rfind(']');
-            if (std::string::npos == e)
-                throw std::runtime_error("parse: " + str);
-
-            if (!port)
-            {
-                auto f = e + 2;
-                if (f < str.size())
-                {
-                    // чтобы не копировать строку
-                    auto port_str = std::string_view(str).substr(f);
-                    if (!port_str.empty())
-                        port = std::atoi(port_str.data());
-                }
-            }
-
-            // пропускаем скобки
-            return str.substr(1, e - 1);
+            int port = 0;
+            auto p = ip::port_from_chars(res.ptr + 1, last, port);
+            if (p.ec != std::errc())
+                return { first, p.ec };
+
+            sin6.sin6_port = htons(static_cast<port_type>(port));
+            res.ptr = p.ptr;
         }
 
-        return str;
+        return res;
     }
 
     sockaddr* selfaddr() noexcept
@@ -137,20 +138,34 @@ public:
     {
         assert((port >= 0) && (port < 65536));
 
-        auto sin6 = empty_sockaddr_in6();
-        sin6.sin6_family = AF_INET6;
-        auto addr_str = parse(str, port);
-        auto res = inet_pton(AF_INET6, addr_str.c_str(), &sin6.sin6_addr);
-        if (code::fail == res)
-            throw std::system_error(net::error_code(), addr_str);
-        if (1 != res)
-            throw std::runtime_error("inet_pton");
+        sockaddr_in6 sin6;
+        auto last = str.data() + str.size();
+        auto res = parse(str.data(), last, sin6);
+        if ((res.ec != std::errc()) || (res.ptr != last))
+            throw std::runtime_error("parse ipv6: " + str);
         if (port)
             sin6.sin6_port = htons(static_cast<port_type>(port));
 
         assign(sin6);
     }
 
+    // без аллокаций, ptr - первый неразобранный символ
+    // при ошибке адрес не меняется
+    std::from_chars_result from_chars(const char *first,
+        const char *last) noexcept
+    {
+        sockaddr_in6 sin6;
+        auto res = parse(first, last, sin6);
+        if (res.ec == std::errc())
+            assign(sin6);
+        return res;
+    }
+
+    std::from_chars_result from_chars(std::string_view text) noexcept
+    {
+        return from_chars(text.data(), text.data() + text.size());
+    }
+
     void assign(const in6_addr& in_addr, int port = 0) noexcept
     {
         assert((port >= 0) && (port < 65536));
@@ -188,6 +203,30 @@ public:
         return static_cast<int>(ntohs(sockaddr_in6_.sin6_port));
     }
 
+    // with_port - "[addr]:port" если порт задан, как в operator<<
+    std::to_chars_result to_chars(char *first, char *last,
+        bool with_port = false) const noexcept
+    {
+        auto p = port();
+        if (!with_port || !p)
+            return ip::to_chars(first, last, sockaddr_in6_.sin6_addr);
+
+        if (first == last)
+            return { last, std::errc::value_too_large };
+
+        auto res = ip::to_chars(first + 1, last, sockaddr_in6_.sin6_addr);
+        if (res.ec != std::errc())
+            return res;
+
+        if (last - res.ptr < 2)
+            return { last, std::errc::value_too_large };
+
+        *first = '[';
+        *res.ptr++ = ']';
+        *res.ptr++ = ':';
+        return ip::port_to_chars(res.ptr, last, p);
+    }
+
 private:
     template<class T>
     struct print
@@ -196,10 +235,10 @@ private:
         {
             T str;
             str.reserve(128);
-            auto res = inet_ntop(sa.family(), &sa->sin6_addr,
-                str.data(), static_cast<ev_socklen_t>(str.capacity()));
-            if (res)
-                str.resize(std::strlen(res));
+            auto ptr = str.data();
+            auto res = sa.to_chars(ptr, ptr + str.capacity());
+            str.resize((res.ec == std::errc()) ?
+                static_cast<std::size_t>(res.ptr - ptr) : 0);
             return str;
         }
     };
@@ -213,8 +252,9 @@ public:
 
     std::string to_string() const
     {
-        auto text = to_text();
-        return std::string(text.data(), text.size());
+        char buf[capacity];
+        auto res = to_chars(buf, buf + sizeof(buf));
+        return std::string(buf, static_cast<std::size_t>(res.ptr - buf));
     }
 };
 
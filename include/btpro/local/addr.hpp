@@ -0,0 +1,185 @@
+#pragma once
+
+#include "btpro/ip/addr.hpp"
+
+#ifndef _WIN32
+
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace btpro {
+namespace local {
+
+// адрес AF_UNIX
+// "/path" - файл сокета, "@name" - абстрактное имя (linux)
+// пустой - безымянный сокет, например клиент или socketpair
+class addr
+    : public ip::addr
+{
+public:
+    constexpr static ev_socklen_t capacity = sizeof(sockaddr_un);
+    // длина адреса без имени
+    constexpr static ev_socklen_t header = offsetof(sockaddr_un, sun_path);
+    constexpr static auto max_path = sizeof(sockaddr_un::sun_path);
+
+    static inline sockaddr_un create_sockaddr_un() noexcept
+    {
+        sockaddr_un res;
+        std::memset(&res, 0, sizeof(res));
+        res.sun_family = AF_UNIX;
+        return res;
+    }
+
+private:
+    sockaddr_un sockaddr_un_ = create_sockaddr_un();
+
+    sockaddr* selfaddr() noexcept
+    {
+        return reinterpret_cast<sockaddr*>(&sockaddr_un_);
+    }
+
+    std::size_t name_size() const noexcept
+    {
+        return (size() > header) ?
+            static_cast<std::size_t>(size() - header) : 0;
+    }
+
+public:
+    addr() noexcept
+        : ip::addr(selfaddr(), header)
+    {   }
+
+    addr(const addr& other) noexcept
+        : ip::addr(selfaddr(), other.size())
+        , sockaddr_un_(other.sockaddr_un_)
+    {   }
+
+    addr& operator=(const addr& other) noexcept
+    {
+        sockaddr_un_ = other.sockaddr_un_;
+        set_socklen(other.size());
+        return *this;
+    }
+
+    explicit addr(std::string_view path)
+        : ip::addr(selfaddr(), header)
+    {
+        assign(path);
+    }
+
+    explicit addr(const char *path)
+        : addr(std::string_view(path))
+    {   }
+
+    explicit addr(const std::string& path)
+        : addr(std::string_view(path))
+    {   }
+
+    addr(const sockaddr *sa, ev_socklen_t salen)
+        : ip::addr(selfaddr(), header)
+    {
+        assign(sa, salen);
+    }
+
+    addr(const ip::addr& other)
+        : addr(other.sa(), other.size())
+    {   }
+
+    void assign(std::string_view path)
+    {
+        auto abstract = !path.empty() && ((path[0] == '@') || (path[0] == '\0'));
+        // у пути файла нужен завершающий ноль
+        if (path.size() + !abstract > max_path)
+            throw std::runtime_error("local path: " + std::string(path));
+
+        sockaddr_un_ = create_sockaddr_un();
+        if (path.empty())
+        {
+            set_socklen(header);
+            return;
+        }
+
+        std::memcpy(sockaddr_un_.sun_path, path.data(), path.size());
+        if (abstract)
+        {
+            sockaddr_un_.sun_path[0] = '\0';
+            set_socklen(static_cast<ev_socklen_t>(header + path.size()));
+        }
+        else
+            set_socklen(static_cast<ev_socklen_t>(header + path.size() + 1));
+    }
+
+    void assign(const sockaddr *sa, ev_socklen_t salen)
+    {
+        assert(sa);
+        if ((sa->sa_family != AF_UNIX) || (salen < sizeof(sa->sa_family)) ||
+            (salen > capacity))
+        {
+            throw std::runtime_error("local addr family");
+        }
+
+        sockaddr_un_ = create_sockaddr_un();
+        std::memcpy(&sockaddr_un_, sa, salen);
+        set_socklen(std::max(salen, header));
+    }
+
+    bool unnamed() const noexcept
+    {
+        return !name_size();
+    }
+
+    bool abstract() const noexcept
+    {
+        return name_size() && (sockaddr_un_.sun_path[0] == '\0');
+    }
+
+    // имя без завершающего нуля, абстрактное без ведущего нуля
+    std::string_view path() const noexcept
+    {
+        auto size = name_size();
+        if (!size)
+            return std::string_view();
+
+        auto ptr = sockaddr_un_.sun_path;
+        if (ptr[0] == '\0')
+            return std::string_view(ptr + 1, size - 1);
+
+        return std::string_view(ptr, strnlen(ptr, size));
+    }
+
+    // в формате конструктора
+    std::string to_string() const
+    {
+        auto p = path();
+        return (abstract()) ? '@' + std::string(p) : std::string(p);
+    }
+
+    // удалить файл сокета, например старый перед bind
+    void unlink() const noexcept
+    {
+        if (unnamed() || abstract())
+            return;
+
+        char buf[max_path + 1]{};
+        auto p = path();
+        std::memcpy(buf, p.data(), p.size());
+        ::unlink(buf);
+    }
+};
+
+} // namespace local
+} // namespace btpro
+
+template<class T, class C>
+std::basic_ostream<T, C>& operator<<(
+    std::basic_ostream<T, C>& os, const btpro::local::addr& local_addr)
+{
+    return os << local_addr.to_string();
+}
+
+#endif // _WIN32
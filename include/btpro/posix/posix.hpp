@@ -5,6 +5,7 @@
 #include "event2/util.h"
 
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <sys/uio.h>
 
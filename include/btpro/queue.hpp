@@ -156,6 +156,46 @@ public:
         return event_base_got_break(assert_handle()) != 0;
     }
 
+    bool exited() const noexcept
+    {
+        return event_base_got_exit(assert_handle()) != 0;
+    }
+
+    // опрос очереди без блокировки в течение budget
+    // затем одно блокирующее ожидание
+    // меньше задержка пробуждения ценой загрузки ядра
+    // false - нет событий
+    template<class Rep, class Period>
+    bool spin(std::chrono::duration<Rep, Period> budget)
+    {
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        do
+        {
+            if (!loop(EVLOOP_NONBLOCK))
+                return false;
+
+            if (stopped() || exited())
+                return true;
+
+        } while (std::chrono::steady_clock::now() < deadline);
+
+        return loop(EVLOOP_ONCE);
+    }
+
+    // dispatch в режиме spin
+    // работает до loop_break, loopexit или пока есть события
+    template<class Rep, class Period>
+    bool dispatch_spin(std::chrono::duration<Rep, Period> budget)
+    {
+        while (spin(budget))
+        {
+            if (stopped() || exited())
+                return true;
+        }
+
+        return false;
+    }
+
 #ifdef EVENT_MAX_PRIORITIES
     void priority_init(int level)
     {
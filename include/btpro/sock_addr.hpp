@@ -2,6 +2,7 @@
 
 #include "btpro/ipv4/addr.hpp"
 #include "btpro/ipv6/addr.hpp"
+#include "btpro/local/addr.hpp"
 
 namespace btpro {
 
@@ -50,6 +51,20 @@ private:
         return reinterpret_cast<sockaddr*>(&sockaddr_storage_);
     }
 
+    void assign4(const ipv4::addr& a) noexcept
+    {
+        sockaddr_storage_ = empty_sockaddr_storage();
+        std::memcpy(&sockaddr_storage_, &a.data(), sizeof(sockaddr_in));
+        set_socklen(sizeof(sockaddr_in));
+    }
+
+    void assign6(const ipv6::addr& a) noexcept
+    {
+        sockaddr_storage_ = empty_sockaddr_storage();
+        std::memcpy(&sockaddr_storage_, &a.data(), sizeof(sockaddr_in6));
+        set_socklen(sizeof(sockaddr_in6));
+    }
+
 public:
     sock_addr()
         : ip::addr(selfaddr())
@@ -106,6 +121,19 @@ public:
     {
         assert(str && (size > 0));
 
+#ifndef _WIN32
+        // "unix:/path" или "unix:@name"
+        static const char unix_prefix[] = "unix:";
+        constexpr static auto unix_prefix_size = sizeof(unix_prefix) - 1;
+        if ((size > unix_prefix_size) &&
+            (std::memcmp(str, unix_prefix, unix_prefix_size) == 0))
+        {
+            assign(local::addr(std::string_view(str + unix_prefix_size,
+                size - unix_prefix_size)));
+            return;
+        }
+#endif // _WIN32
+
         static const char localhost[] = "localhost";
         constexpr static auto localhost_size = sizeof(localhost) - 1;
         // ':' and port number
@@ -119,9 +147,15 @@ public:
         }
         else
         {
+            auto res = from_chars(str, str + size);
+            if ((res.ec == std::errc()) && (res.ptr == str + size))
+                return;
+
+            // разбор libevent для сообщения об ошибке
             int len = capacity;
             detail::check_result("evutil_parse_sockaddr_port",
-                evutil_parse_sockaddr_port(str, sa(), &len));
+                evutil_parse_sockaddr_port(std::string(str, size).c_str(),
+                    sa(), &len));
             set_socklen(static_cast<ev_socklen_t>(len));
         }
     }
@@ -131,6 +165,56 @@ public:
         assign(text.c_str(), text.size());
     }
 
+    // "a.b.c.d[:port]", "[addr6][:port]" или "addr6", без аллокаций
+    // ptr - первый неразобранный символ, при ошибке адрес не меняется
+    std::from_chars_result from_chars(const char *first,
+        const char *last) noexcept
+    {
+        assert(first <= last);
+
+        if ((first != last) && (*first != '['))
+        {
+            ipv4::addr a4;
+            auto res = a4.from_chars(first, last);
+            if (res.ec == std::errc())
+            {
+                assign4(a4);
+                return res;
+            }
+        }
+
+        ipv6::addr a6;
+        auto res = a6.from_chars(first, last);
+        if (res.ec == std::errc())
+            assign6(a6);
+        return res;
+    }
+
+    std::from_chars_result from_chars(std::string_view text) noexcept
+    {
+        return from_chars(text.data(), text.data() + text.size());
+    }
+
+    // with_port - порт если задан, как в operator<<
+    std::to_chars_result to_chars(char *first, char *last,
+        bool with_port = false) const noexcept
+    {
+        auto fm = family();
+
+        if (fm == AF_INET)
+        {
+            return ipv4::addr(*reinterpret_cast<const sockaddr_in*>(sa()))
+                .to_chars(first, last, with_port);
+        }
+        else if (fm == AF_INET6)
+        {
+            return ipv6::addr(*reinterpret_cast<const sockaddr_in6*>(sa()))
+                .to_chars(first, last, with_port);
+        }
+
+        return { first, std::errc::address_family_not_supported };
+    }
+
     void resize(ev_socklen_t salen) noexcept
     {
         set_socklen(salen);
@@ -167,6 +251,10 @@ public:
             return ipv4::addr(*this).to_string();
         else if (fm == AF_INET6)
             return ipv6::addr(*this).to_string();
+#ifndef _WIN32
+        else if (fm == AF_UNIX)
+            return local::addr(*this).to_string();
+#endif // _WIN32
 
         return std::string();
     }
@@ -184,6 +272,10 @@ std::basic_ostream<T, C>& operator<<(
         os << btpro::ipv4::addr(saddr);
     else if (fm == AF_INET6)
         os << btpro::ipv6::addr(saddr);
+#ifndef _WIN32
+    else if (fm == AF_UNIX)
+        os << btpro::local::addr(saddr);
+#endif // _WIN32
 
     return os;
 }
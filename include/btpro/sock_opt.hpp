@@ -13,6 +13,9 @@ namespace btpro {
 constexpr static auto sock_nonblock = int{ BTPRO_SOCK_NONBLOCK };
 constexpr static auto sock_dgram = int{ SOCK_DGRAM|sock_nonblock };
 constexpr static auto sock_stream = int{ SOCK_STREAM|sock_nonblock };
+#ifdef SOCK_SEQPACKET
+constexpr static auto sock_seqpacket = int{ SOCK_SEQPACKET|sock_nonblock };
+#endif // SOCK_SEQPACKET
 
 template<class T, int SO_LEVEL, int SO_OPTID>
 class sock_basic_option
@@ -166,4 +169,365 @@ static inline detail::type off() noexcept
 } // namespace zerocopy
 #endif // SO_ZEROCOPY
 
+#ifdef SO_TIMESTAMPNS
+namespace timestampns {
+namespace detail {
+    static const char name[] = "SO_TIMESTAMPNS";
+    typedef sock_basic_option<int, SOL_SOCKET, SO_TIMESTAMPNS> type;
+} // namespace detail
+
+static inline detail::type on() noexcept
+{
+    return detail::type(1, detail::name);
+}
+
+static inline detail::type off() noexcept
+{
+    return detail::type(0, detail::name);
+}
+
+} // namespace timestampns
+#endif // SO_TIMESTAMPNS
+
+#ifdef UDP_GRO
+// приём склеенных ядром датаграмм одного размера
+// размер сегмента приходит в cmsg UDP_GRO
+namespace udp_gro {
+namespace detail {
+    static const char name[] = "UDP_GRO";
+    typedef sock_basic_option<int, IPPROTO_UDP, UDP_GRO> type;
+} // namespace detail
+
+static inline detail::type on() noexcept
+{
+    return detail::type(1, detail::name);
+}
+
+static inline detail::type off() noexcept
+{
+    return detail::type(0, detail::name);
+}
+
+} // namespace udp_gro
+#endif // UDP_GRO
+
+#ifdef UDP_SEGMENT
+// отправка буфера нарезанного ядром на датаграммы
+// размер по умолчанию для всех send на сокете
+namespace udp_segment {
+namespace detail {
+    static const char name[] = "UDP_SEGMENT";
+    typedef sock_basic_option<int, IPPROTO_UDP, UDP_SEGMENT> type;
+} // namespace detail
+
+static inline detail::type size(int value) noexcept
+{
+    assert((value >= 0) && (value <= 0xffff));
+    return detail::type(value, detail::name);
+}
+
+static inline detail::type off() noexcept
+{
+    return detail::type(0, detail::name);
+}
+
+} // namespace udp_segment
+#endif // UDP_SEGMENT
+
+#ifdef SO_BUSY_POLL
+// опрос очереди драйвера в recv/poll вместо ожидания прерывания
+// значения выше net.core.busy_read требуют CAP_NET_ADMIN
+namespace busy_poll {
+namespace detail {
+    static const char name[] = "SO_BUSY_POLL";
+    typedef sock_basic_option<int, SOL_SOCKET, SO_BUSY_POLL> type;
+#ifdef SO_BUSY_POLL_BUDGET
+    static const char budget_name[] = "SO_BUSY_POLL_BUDGET";
+    typedef sock_basic_option<int,
+        SOL_SOCKET, SO_BUSY_POLL_BUDGET> budget_type;
+#endif // SO_BUSY_POLL_BUDGET
+} // namespace detail
+
+static inline detail::type usec(int value) noexcept
+{
+    return detail::type(value, detail::name);
+}
+
+#ifdef SO_BUSY_POLL_BUDGET
+// число пакетов за один проход опроса
+static inline detail::budget_type budget(int value) noexcept
+{
+    return detail::budget_type(value, detail::budget_name);
+}
+#endif // SO_BUSY_POLL_BUDGET
+
+} // namespace busy_poll
+#endif // SO_BUSY_POLL
+
+#ifdef SO_PREFER_BUSY_POLL
+namespace prefer_busy_poll {
+namespace detail {
+    static const char name[] = "SO_PREFER_BUSY_POLL";
+    typedef sock_basic_option<int, SOL_SOCKET, SO_PREFER_BUSY_POLL> type;
+} // namespace detail
+
+static inline detail::type on() noexcept
+{
+    return detail::type(1, detail::name);
+}
+
+static inline detail::type off() noexcept
+{
+    return detail::type(0, detail::name);
+}
+
+} // namespace prefer_busy_poll
+#endif // SO_PREFER_BUSY_POLL
+
+#ifdef SO_INCOMING_CPU
+// процессор на котором обрабатываются входящие пакеты
+namespace incoming_cpu {
+namespace detail {
+    static const char name[] = "SO_INCOMING_CPU";
+    typedef sock_basic_option<int, SOL_SOCKET, SO_INCOMING_CPU> type;
+} // namespace detail
+
+static inline detail::type set(int value) noexcept
+{
+    return detail::type(value, detail::name);
+}
+
+} // namespace incoming_cpu
+#endif // SO_INCOMING_CPU
+
+#ifdef TCP_NODELAY
+namespace tcp_nodelay {
+namespace detail {
+    static const char name[] = "TCP_NODELAY";
+    typedef sock_basic_option<int, IPPROTO_TCP, TCP_NODELAY> type;
+} // namespace detail
+
+static inline detail::type on() noexcept
+{
+    return detail::type(1, detail::name);
+}
+
+static inline detail::type off() noexcept
+{
+    return detail::type(0, detail::name);
+}
+
+} // namespace tcp_nodelay
+#endif // TCP_NODELAY
+
+#ifdef TCP_QUICKACK
+// флаг не постоянный, ядро может сбросить его
+// выставлять повторно после чтения
+namespace tcp_quickack {
+namespace detail {
+    static const char name[] = "TCP_QUICKACK";
+    typedef sock_basic_option<int, IPPROTO_TCP, TCP_QUICKACK> type;
+} // namespace detail
+
+static inline detail::type on() noexcept
+{
+    return detail::type(1, detail::name);
+}
+
+static inline detail::type off() noexcept
+{
+    return detail::type(0, detail::name);
+}
+
+} // namespace tcp_quickack
+#endif // TCP_QUICKACK
+
+#ifdef SO_RCVLOWAT
+namespace rcvlowat {
+namespace detail {
+    static const char name[] = "SO_RCVLOWAT";
+    typedef sock_basic_option<int, SOL_SOCKET, SO_RCVLOWAT> type;
+} // namespace detail
+
+static inline detail::type size(int value) noexcept
+{
+    return detail::type(value, detail::name);
+}
+
+} // namespace rcvlowat
+#endif // SO_RCVLOWAT
+
+#ifdef TCP_NOTSENT_LOWAT
+namespace tcp_notsent_lowat {
+namespace detail {
+    static const char name[] = "TCP_NOTSENT_LOWAT";
+    typedef sock_basic_option<int, IPPROTO_TCP, TCP_NOTSENT_LOWAT> type;
+} // namespace detail
+
+static inline detail::type size(int value) noexcept
+{
+    return detail::type(value, detail::name);
+}
+
+} // namespace tcp_notsent_lowat
+#endif // TCP_NOTSENT_LOWAT
+
+#ifdef IP_TOS
+namespace ip_tos {
+namespace detail {
+    static const char name[] = "IP_TOS";
+    typedef sock_basic_option<int, IPPROTO_IP, IP_TOS> type;
+} // namespace detail
+
+static inline detail::type value(int value) noexcept
+{
+    return detail::type(value, detail::name);
+}
+
+} // namespace ip_tos
+#endif // IP_TOS
+
+#ifdef SO_PRIORITY
+namespace priority {
+namespace detail {
+    static const char name[] = "SO_PRIORITY";
+    typedef sock_basic_option<int, SOL_SOCKET, SO_PRIORITY> type;
+} // namespace detail
+
+static inline detail::type value(int value) noexcept
+{
+    return detail::type(value, detail::name);
+}
+
+} // namespace priority
+#endif // SO_PRIORITY
+
+// набор опций для сокетов чувствительных к задержке
+// применяются только заданные значения
+class low_latency
+{
+    constexpr static auto unset = int{ -1 };
+
+    int busy_poll_{unset};
+    int busy_poll_budget_{unset};
+    int prefer_busy_poll_{unset};
+    int incoming_cpu_{unset};
+    int nodelay_{unset};
+    int quickack_{unset};
+    int rcvlowat_{unset};
+    int notsent_lowat_{unset};
+    int tos_{unset};
+    int priority_{unset};
+
+public:
+    low_latency() = default;
+
+    low_latency& busy_poll(int usec, int budget = unset) noexcept
+    {
+        busy_poll_ = usec;
+        busy_poll_budget_ = budget;
+        return *this;
+    }
+
+    low_latency& prefer_busy_poll(bool value = true) noexcept
+    {
+        prefer_busy_poll_ = value;
+        return *this;
+    }
+
+    low_latency& incoming_cpu(int cpu) noexcept
+    {
+        incoming_cpu_ = cpu;
+        return *this;
+    }
+
+    low_latency& nodelay(bool value = true) noexcept
+    {
+        nodelay_ = value;
+        return *this;
+    }
+
+    low_latency& quickack(bool value = true) noexcept
+    {
+        quickack_ = value;
+        return *this;
+    }
+
+    low_latency& rcvlowat(int value) noexcept
+    {
+        rcvlowat_ = value;
+        return *this;
+    }
+
+    low_latency& notsent_lowat(int value) noexcept
+    {
+        notsent_lowat_ = value;
+        return *this;
+    }
+
+    low_latency& tos(int value) noexcept
+    {
+        tos_ = value;
+        return *this;
+    }
+
+    low_latency& priority(int value) noexcept
+    {
+        priority_ = value;
+        return *this;
+    }
+
+    // tcp опции применяются только если stream == true
+    void apply(evutil_socket_t fd, bool stream = true) const
+    {
+#ifdef SO_BUSY_POLL
+        if (busy_poll_ != unset)
+            busy_poll::usec(busy_poll_).apply(fd);
+#endif // SO_BUSY_POLL
+#ifdef SO_BUSY_POLL_BUDGET
+        if (busy_poll_budget_ != unset)
+            busy_poll::budget(busy_poll_budget_).apply(fd);
+#endif // SO_BUSY_POLL_BUDGET
+#ifdef SO_PREFER_BUSY_POLL
+        if (prefer_busy_poll_ != unset)
+        {
+            (prefer_busy_poll_) ? prefer_busy_poll::on().apply(fd) :
+                prefer_busy_poll::off().apply(fd);
+        }
+#endif // SO_PREFER_BUSY_POLL
+#ifdef SO_INCOMING_CPU
+        if (incoming_cpu_ != unset)
+            incoming_cpu::set(incoming_cpu_).apply(fd);
+#endif // SO_INCOMING_CPU
+#ifdef SO_RCVLOWAT
+        if (rcvlowat_ != unset)
+            rcvlowat::size(rcvlowat_).apply(fd);
+#endif // SO_RCVLOWAT
+#ifdef IP_TOS
+        if (tos_ != unset)
+            ip_tos::value(tos_).apply(fd);
+#endif // IP_TOS
+#ifdef SO_PRIORITY
+        if (priority_ != unset)
+            priority::value(priority_).apply(fd);
+#endif // SO_PRIORITY
+
+        if (!stream)
+            return;
+
+#ifdef TCP_NODELAY
+        if (nodelay_ != unset)
+            (nodelay_) ? tcp_nodelay::on().apply(fd) : tcp_nodelay::off().apply(fd);
+#endif // TCP_NODELAY
+#ifdef TCP_QUICKACK
+        if (quickack_ != unset)
+            (quickack_) ? tcp_quickack::on().apply(fd) : tcp_quickack::off().apply(fd);
+#endif // TCP_QUICKACK
+#ifdef TCP_NOTSENT_LOWAT
+        if (notsent_lowat_ != unset)
+            tcp_notsent_lowat::size(notsent_lowat_).apply(fd);
+#endif // TCP_NOTSENT_LOWAT
+    }
+};
+
 } // namespace btpro
@@ -2,6 +2,9 @@
 
 #include "btpro/sock_addr.hpp"
 #include "btpro/sock_opt.hpp"
+#include "btpro/timestamp.hpp"
+
+#include <utility>
 
 namespace btpro {
 
@@ -9,6 +12,12 @@ class socket
 {
     evutil_socket_t socket_{ net::invalid };
 
+public:
+    // дескрипторов в одном send_fds, SCM_MAX_FD в linux 253
+    constexpr static std::size_t max_fds = 64;
+
+private:
+
     void do_close() noexcept
     {
         evutil_closesocket(socket_);
@@ -73,6 +82,18 @@ public:
         set(opts...);
     }
 
+    void set(const low_latency& profile)
+    {
+        profile.apply(fd());
+    }
+
+    template<class... T>
+    void set(const low_latency& profile, const T& ...opts)
+    {
+        set(profile);
+        set(opts...);
+    }
+
     // create socket only
     // if you need blocking socket use attach( blocking_sock )
     void create(int domain, int type)
@@ -171,6 +192,205 @@ public:
         return res;
     }
 
+    ev_ssize_t sendmsg(const msghdr *msg, int flags = 0) noexcept
+    {
+        return ::sendmsg(socket_, msg, flags);
+    }
+
+    ev_ssize_t recvmsg(msghdr *msg, int flags = 0) noexcept
+    {
+        return ::recvmsg(socket_, msg, flags);
+    }
+
+#ifdef SO_TIMESTAMPING
+    // прием с отметками времени
+    // см. timestampns и timestamping::flags
+    ev_ssize_t recvfrom(sock_addr& sa, char *buf, std::size_t len,
+        packet_stamp& stamp, int flags = 0) noexcept
+    {
+        iovec iov{ buf, len };
+        alignas(cmsghdr) char control[timestamping::control_size +
+            CMSG_SPACE(sizeof(timespec))];
+
+        msghdr msg{};
+        msg.msg_name = sa.sa();
+        msg.msg_namelen = sock_addr::capacity;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        stamp = packet_stamp();
+        auto res = recvmsg(&msg, flags);
+        if (res != code::fail)
+        {
+            sa.resize(msg.msg_namelen);
+            timestamping::parse(msg, stamp);
+        }
+
+        return res;
+    }
+
+    ev_ssize_t recv(char *buf, std::size_t len,
+        packet_stamp& stamp, int flags = 0) noexcept
+    {
+        sock_addr sa;
+        return recvfrom(sa, buf, len, stamp, flags);
+    }
+
+    // отметка отправки из очереди ошибок
+    // ожидать готовности можно по EV_READ (POLLERR)
+    // 0 - сообщение не является отметкой
+    ev_ssize_t recv_tx_stamp(tx_stamp& stamp) noexcept
+    {
+        char data[64];
+        iovec iov{ data, sizeof(data) };
+        alignas(cmsghdr) char control[timestamping::control_size +
+            CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        stamp = tx_stamp();
+        auto res = recvmsg(&msg, MSG_ERRQUEUE|MSG_DONTWAIT);
+        if (res == code::fail)
+            return res;
+
+        return timestamping::parse(msg, stamp) ? 1 : 0;
+    }
+#endif // SO_TIMESTAMPING
+
+#ifndef _WIN32
+    // пара связанных неблокирующих сокетов AF_UNIX
+    // type - sock_stream, sock_dgram или sock_seqpacket
+    static std::pair<socket, socket> pair(int type = sock_stream)
+    {
+        int fds[2];
+#ifdef SOCK_CLOEXEC
+        type |= SOCK_CLOEXEC;
+#endif // SOCK_CLOEXEC
+        if (::socketpair(AF_UNIX, type|sock_nonblock, 0, fds) == code::fail)
+            throw std::system_error(net::error_code(), "::socketpair");
+
+        std::pair<socket, socket> rc{ socket(fds[0]), socket(fds[1]) };
+#ifndef SOCK_NONBLOCK
+        try
+        {
+            rc.first.make_socket_nonblocking();
+            rc.second.make_socket_nonblocking();
+        }
+        catch (...)
+        {
+            rc.first.close();
+            rc.second.close();
+            throw;
+        }
+#endif // SOCK_NONBLOCK
+        return rc;
+    }
+
+    // передача дескрипторов через SCM_RIGHTS вместе с данными
+    // для AF_UNIX нужен хотя бы один байт данных
+    // дескрипторы остаются открытыми у отправителя
+    ev_ssize_t send_fds(const char *buf, std::size_t len,
+        const evutil_socket_t *fds, std::size_t count, int flags = 0) noexcept
+    {
+        assert(buf && len && fds && count && (count <= max_fds));
+
+        iovec iov{ const_cast<char*>(buf), len };
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_fds)]{};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+        auto cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            int fd = fds[i];
+            std::memcpy(CMSG_DATA(cmsg) + i * sizeof(int), &fd, sizeof(fd));
+        }
+
+        return sendmsg(&msg, flags);
+    }
+
+    // прием данных и дескрипторов, в count - число полученных
+    // лишние дескрипторы сверх fds ядро закрывает и ставит MSG_CTRUNC,
+    // тогда truncated - часть переданных дескрипторов потеряна
+    // полученные дескрипторы с FD_CLOEXEC
+    ev_ssize_t recv_fds(char *buf, std::size_t len, evutil_socket_t *fds,
+        std::size_t& count, bool& truncated, int flags = 0) noexcept
+    {
+        assert(buf && len && fds && (count <= max_fds));
+
+        iovec iov{ buf, len };
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_fds)]{};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+#ifdef MSG_CMSG_CLOEXEC
+        flags |= MSG_CMSG_CLOEXEC;
+#endif // MSG_CMSG_CLOEXEC
+
+        auto capacity = count;
+        count = 0;
+        truncated = false;
+        auto res = recvmsg(&msg, flags);
+        if (res == code::fail)
+            return res;
+
+        truncated = (msg.msg_flags & MSG_CTRUNC) != 0;
+
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if ((cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS))
+                continue;
+
+            auto n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+#ifndef MSG_CMSG_CLOEXEC
+                evutil_make_socket_closeonexec(fd);
+#endif // MSG_CMSG_CLOEXEC
+                if (count < capacity)
+                    fds[count++] = fd;
+                else
+                {
+                    evutil_closesocket(fd);
+                    truncated = true;
+                }
+            }
+        }
+
+        return res;
+    }
+#endif // _WIN32
+
+#ifdef __linux__
+    int recvmmsg(mmsghdr *vec, unsigned int vlen,
+        int flags = 0, timespec *timeout = nullptr) noexcept
+    {
+        return ::recvmmsg(socket_, vec, vlen, flags, timeout);
+    }
+
+    int sendmmsg(mmsghdr *vec, unsigned int vlen, int flags = 0) noexcept
+    {
+        return ::sendmmsg(socket_, vec, vlen, flags);
+    }
+#endif // __linux__
+
     class guard
     {
         socket& socket_;
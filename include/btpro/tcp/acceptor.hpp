@@ -1,6 +1,8 @@
 #pragma once
 
 #include "btpro/tcp/listener.hpp"
+#include "btpro/tcp/admission.hpp"
+#include "btpro/ip/prefix.hpp"
 #include "btpro/socket.hpp"
 
 namespace btpro {
@@ -16,6 +18,10 @@ private:
     listener listener_{};
     handler_t handler_{};
     throw_t on_throw_{};
+    const ip::lpm<bool> *acl_{nullptr};
+    bool acl_default_{true};
+    std::uint64_t denied_{};
+    admission *admission_{nullptr};
 
     template<class T>
     struct proxy
@@ -32,8 +38,21 @@ private:
     {
         try
         {
-            handler_(socket(sock), ip::addr::create(sa,
-                static_cast<socklen_t>(salen)));
+            auto addr = ip::addr::create(sa, static_cast<socklen_t>(salen));
+            if (acl_ && !acl_->allow(addr, acl_default_))
+            {
+                evutil_closesocket(sock);
+                ++denied_;
+                return;
+            }
+
+            if (admission_ && (admission_->admit(addr) != admission::accept))
+            {
+                evutil_closesocket(sock);
+                return;
+            }
+
+            handler_(socket(sock), addr);
         }
         catch(...)
         {
@@ -62,6 +81,23 @@ public:
             backlog, sa, proxy<acceptor>::evcb, this);
     }
 
+    // уже слушающий сокет, владение переходит к acceptor
+    acceptor(queue_handle_t queue, unsigned int flags,
+        socket sock, handler_t handler)
+        : handler_(std::move(handler))
+    {
+        assert(queue && handler_);
+        listener_.listen(queue, flags, sock, proxy<acceptor>::evcb, this);
+    }
+
+    acceptor(const acceptor&) = delete;
+    acceptor& operator=(const acceptor&) = delete;
+
+    ~acceptor() noexcept
+    {
+        clear_admission();
+    }
+
     acceptor& set(handler_t handler)
     {
         assert(handler);
@@ -75,6 +111,56 @@ public:
         return *this;
     }
 
+    // адреса проверяются до handler, запрещенные сразу закрываются
+    // allow_default - для адресов вне таблицы
+    // acl должна жить дольше acceptor
+    acceptor& set(const ip::lpm<bool>& acl, bool allow_default = true) noexcept
+    {
+        acl_ = &acl;
+        acl_default_ = allow_default;
+        return *this;
+    }
+
+    void clear_acl() noexcept
+    {
+        acl_ = nullptr;
+    }
+
+    // ограничения приема, отклоненные соединения сразу закрываются
+    // принятые учтены в ctl, при их закрытии нужен ctl.release(addr)
+    // ctl останавливает и возобновляет прием этого acceptor
+    // ctl должен жить дольше acceptor
+    acceptor& set(admission& ctl)
+    {
+        clear_admission();
+        admission_ = &ctl;
+        ctl.set(admission::pause_t([this](bool pause) {
+            (pause) ? listener_.disable() : listener_.enable();
+        }));
+        return *this;
+    }
+
+    void clear_admission() noexcept
+    {
+        if (admission_)
+        {
+            admission_->set(admission::pause_t());
+            admission_ = nullptr;
+        }
+    }
+
+    // число закрытых по acl соединений
+    std::uint64_t denied() const noexcept
+    {
+        return denied_;
+    }
+
+    // слушающий сокет, например для handoff
+    socket sock() const noexcept
+    {
+        return socket(listener_.fd());
+    }
+
     void enable()
     {
         listener_.enable();
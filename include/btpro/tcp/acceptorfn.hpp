@@ -1,6 +1,7 @@
 #pragma once
 
 #include "btpro/tcp/listener.hpp"
+#include "btpro/ip/prefix.hpp"
 #include "btpro/socket.hpp"
 
 namespace btpro {
@@ -19,6 +20,9 @@ private:
     callback_fn fn_{ nullptr };
     throw_fn throw_fn_{ nullptr };
     listener listener_{};
+    const ip::lpm<bool> *acl_{nullptr};
+    bool acl_default_{true};
+    std::uint64_t denied_{};
 
     template<class A>
     struct proxy
@@ -46,8 +50,15 @@ private:
     {
         try
         {
-            (self_.*fn_)(be::socket(fd),
-                ip::addr::create(sa, static_cast<socklen_t>(salen)));
+            auto addr = ip::addr::create(sa, static_cast<socklen_t>(salen));
+            if (acl_ && !acl_->allow(addr, acl_default_))
+            {
+                evutil_closesocket(fd);
+                ++denied_;
+                return;
+            }
+
+            (self_.*fn_)(be::socket(fd), addr);
         }
         catch (...)
         {
@@ -115,6 +126,27 @@ public:
         return *this;
     }
 
+    // адреса проверяются до fn, запрещенные сразу закрываются
+    // allow_default - для адресов вне таблицы
+    // acl должна жить дольше acceptorfn
+    acceptorfn& set(const ip::lpm<bool>& acl, bool allow_default = true) noexcept
+    {
+        acl_ = &acl;
+        acl_default_ = allow_default;
+        return *this;
+    }
+
+    void clear_acl() noexcept
+    {
+        acl_ = nullptr;
+    }
+
+    // число закрытых по acl соединений
+    std::uint64_t denied() const noexcept
+    {
+        return denied_;
+    }
+
     void enable()
     {
         listener_.enable();
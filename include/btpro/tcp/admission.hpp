@@ -0,0 +1,384 @@
+#pragma once
+
+#include "btpro/ip/endpoint_map.hpp"
+#include "btpro/ev.hpp"
+
+#include <functional>
+
+#ifdef __linux__
+#include <dirent.h>
+#endif // __linux__
+
+namespace btpro {
+namespace tcp {
+
+// ограничения приема, нулевое значение - без ограничения
+struct admission_policy
+{
+    // одновременных соединений
+    std::size_t max_conn{};
+    // одновременных соединений с одного адреса
+    std::size_t max_per_ip{};
+    // token bucket: соединений в секунду и запас
+    double rate{};
+    double burst{};
+    // период проверки задержки очереди и числа дескрипторов
+    std::chrono::milliseconds interval{100};
+    // пауза при превышении high, возобновление ниже low
+    std::chrono::milliseconds lag_high{};
+    std::chrono::milliseconds lag_low{};
+    std::size_t fd_high{};
+    std::size_t fd_low{};
+    // дескрипторы помимо соединений: слушающие сокеты, файлы, клиенты
+    // 0 - один раз посчитать при start
+    std::size_t fd_base{};
+};
+
+// контроль приема соединений
+// admit решает судьбу каждого принятого соединения
+// release вызывается когда соединение закрыто
+// при перегрузке очереди или нехватке дескрипторов прием приостанавливается
+// через pause_t, соединения ждут в очереди listen
+class admission
+{
+public:
+    enum verdict
+    {
+        accept = 0,
+        max_conn,
+        per_ip,
+        rate,
+        overload
+    };
+
+    // true - остановить прием, false - возобновить
+    typedef std::function<void(bool)> pause_t;
+    // число открытых дескрипторов для проверки fd_high
+    typedef std::function<std::size_t()> fd_count_t;
+
+    struct stat
+    {
+        std::uint64_t admitted{};
+        std::uint64_t rejected_max_conn{};
+        std::uint64_t rejected_per_ip{};
+        std::uint64_t rejected_rate{};
+        std::uint64_t rejected_overload{};
+        std::uint64_t pauses{};
+        std::size_t active{};
+        std::size_t fds{};
+        std::chrono::microseconds lag{};
+
+        std::uint64_t rejected() const noexcept
+        {
+            return rejected_max_conn + rejected_per_ip +
+                rejected_rate + rejected_overload;
+        }
+    };
+
+private:
+    // причины паузы
+    constexpr static unsigned by_capacity = 1;
+    constexpr static unsigned by_lag = 2;
+    constexpr static unsigned by_fd = 4;
+
+    using clock = std::chrono::steady_clock;
+
+    admission_policy policy_{};
+    pause_t on_pause_{};
+    fd_count_t fd_count_{};
+    std::size_t fd_base_{};
+    ip::endpoint_map<std::size_t> per_ip_{};
+    double tokens_{};
+    clock::time_point refill_{clock::now()};
+    clock::time_point expect_{};
+    unsigned paused_{};
+    stat stat_{};
+    ev_stack timer_{};
+
+    template<class T>
+    struct proxy
+    {
+        static void evcb(evutil_socket_t, event_flag, void *obj) noexcept
+        {
+            assert(obj);
+            static_cast<T*>(obj)->monitor();
+        }
+    };
+
+    static bool inet(const ip::addr& addr) noexcept
+    {
+        auto family = addr.family();
+        return (family == AF_INET) || (family == AF_INET6);
+    }
+
+    bool take_token() noexcept
+    {
+        if (policy_.rate <= 0)
+            return true;
+
+        auto now = clock::now();
+        std::chrono::duration<double> elapsed = now - refill_;
+        refill_ = now;
+
+        auto burst = (policy_.burst > 0) ? policy_.burst : policy_.rate;
+        tokens_ = std::min(burst, tokens_ + elapsed.count() * policy_.rate);
+        if (tokens_ < 1)
+            return false;
+
+        tokens_ -= 1;
+        return true;
+    }
+
+    void set_pause(unsigned reason, bool on) noexcept
+    {
+        auto was = paused_;
+        paused_ = (on) ? (paused_ | reason) : (paused_ & ~reason);
+        if (!was == !paused_)
+            return;
+
+        if (paused_)
+            ++stat_.pauses;
+
+        try
+        {
+            if (on_pause_)
+                on_pause_(paused_ != 0);
+        }
+        catch (...)
+        {   }
+    }
+
+    // считается на каждом тике, поэтому без обхода /proc:
+    // базовые дескрипторы плюс принятые соединения
+    std::size_t fd_count() const noexcept
+    {
+        try
+        {
+            if (fd_count_)
+                return fd_count_();
+        }
+        catch (...)
+        {   }
+
+        return fd_base_ + stat_.active;
+    }
+
+    void schedule()
+    {
+        expect_ = clock::now() + policy_.interval;
+        timer_.add(policy_.interval);
+    }
+
+    // задержка очереди - насколько позже срабатывает таймер
+    void monitor() noexcept
+    {
+        auto now = clock::now();
+        auto lag = (now > expect_) ? (now - expect_) : clock::duration::zero();
+        stat_.lag = std::chrono::duration_cast<std::chrono::microseconds>(lag);
+
+        if (policy_.lag_high.count())
+        {
+            if (lag > policy_.lag_high)
+                set_pause(by_lag, true);
+            else if (lag <= policy_.lag_low)
+                set_pause(by_lag, false);
+        }
+
+        if (policy_.fd_high)
+        {
+            stat_.fds = fd_count();
+            if (stat_.fds > policy_.fd_high)
+                set_pause(by_fd, true);
+            else if (stat_.fds <= policy_.fd_low)
+                set_pause(by_fd, false);
+        }
+
+        try
+        {
+            schedule();
+        }
+        catch (...)
+        {   }
+    }
+
+public:
+    // открытые дескрипторы процесса по /proc/self/fd
+    // O(число дескрипторов), не для вызова на каждом тике
+    // 0 - посчитать не удалось
+    static std::size_t open_fds() noexcept
+    {
+#ifdef __linux__
+        auto dir = ::opendir("/proc/self/fd");
+        if (dir)
+        {
+            std::size_t rc = 0;
+            while (auto ent = ::readdir(dir))
+            {
+                if (ent->d_name[0] != '.')
+                    ++rc;
+            }
+            ::closedir(dir);
+            // без дескриптора самого каталога
+            return (rc) ? rc - 1 : rc;
+        }
+#endif // __linux__
+        return 0;
+    }
+
+    admission() = default;
+
+    explicit admission(const admission_policy& policy)
+    {
+        set(policy);
+    }
+
+    // с контролем задержки очереди и числа дескрипторов
+    admission(queue_pointer queue, const admission_policy& policy)
+    {
+        set(policy);
+        start(queue);
+    }
+
+    admission(const admission&) = delete;
+    admission& operator=(const admission&) = delete;
+
+    ~admission() noexcept
+    {
+        if (!timer_.empty())
+            timer_.destroy();
+    }
+
+    void set(const admission_policy& policy)
+    {
+        assert(policy.lag_low <= policy.lag_high);
+        assert(policy.fd_low <= policy.fd_high);
+        policy_ = policy;
+        tokens_ = (policy.burst > 0) ? policy.burst : policy.rate;
+        refill_ = clock::now();
+    }
+
+    void set(pause_t fn)
+    {
+        on_pause_ = std::move(fn);
+    }
+
+    // свой счетчик дескрипторов вместо fd_base + active
+    void set(fd_count_t fn)
+    {
+        fd_count_ = std::move(fn);
+    }
+
+    const admission_policy& policy() const noexcept
+    {
+        return policy_;
+    }
+
+    // запускает таймер проверки, если заданы lag_high или fd_high
+    void start(queue_pointer queue)
+    {
+        assert(queue);
+        if (!policy_.lag_high.count() && !policy_.fd_high)
+            return;
+
+        assert(policy_.interval.count() > 0);
+        fd_base_ = policy_.fd_base;
+        if (policy_.fd_high && !fd_base_ && !fd_count_)
+        {
+            // соединения, уже учтенные в active, не входят в базу
+            auto fds = open_fds();
+            fd_base_ = (fds > stat_.active) ? fds - stat_.active : 0;
+        }
+
+        if (timer_.empty())
+            timer_.create(queue, -1, 0, proxy<admission>::evcb, this);
+        schedule();
+    }
+
+    void stop() noexcept
+    {
+        if (!timer_.empty())
+            timer_.destroy();
+        set_pause(by_lag|by_fd, false);
+    }
+
+    // решение по новому соединению
+    // при accept соединение учтено и требует release
+    verdict admit(const ip::addr& addr)
+    {
+        if (paused_ & (by_lag|by_fd))
+        {
+            ++stat_.rejected_overload;
+            return overload;
+        }
+
+        if (policy_.max_conn && (stat_.active >= policy_.max_conn))
+        {
+            // пропущенные до остановки приема
+            set_pause(by_capacity, true);
+            ++stat_.rejected_max_conn;
+            return max_conn;
+        }
+
+        auto limit_ip = policy_.max_per_ip && inet(addr);
+        ip::endpoint_key key;
+        if (limit_ip)
+        {
+            key = ip::endpoint_key(addr).address();
+            auto count = per_ip_.find(key);
+            if (count && (*count >= policy_.max_per_ip))
+            {
+                ++stat_.rejected_per_ip;
+                return per_ip;
+            }
+        }
+
+        if (!take_token())
+        {
+            ++stat_.rejected_rate;
+            return rate;
+        }
+
+        if (limit_ip)
+            ++per_ip_[key];
+        ++stat_.active;
+        ++stat_.admitted;
+
+        // последнее место занято, новые ждут в очереди listen
+        if (policy_.max_conn && (stat_.active >= policy_.max_conn))
+            set_pause(by_capacity, true);
+
+        return accept;
+    }
+
+    // соединение, принятое admit, закрыто
+    void release(const ip::addr& addr) noexcept
+    {
+        assert(stat_.active);
+        if (stat_.active)
+            --stat_.active;
+
+        if (policy_.max_per_ip && inet(addr))
+        {
+            ip::endpoint_key key(addr);
+            auto count = per_ip_.find(key.address());
+            if (count && !--(*count))
+                per_ip_.erase(key.address());
+        }
+
+        if (policy_.max_conn && (stat_.active < policy_.max_conn))
+            set_pause(by_capacity, false);
+    }
+
+    bool paused() const noexcept
+    {
+        return paused_ != 0;
+    }
+
+    const stat& get_stat() const noexcept
+    {
+        return stat_;
+    }
+};
+
+} // namespace tcp
+} // namespace btpro
@@ -0,0 +1,545 @@
+#pragma once
+
+#include "btpro/tcp/admission.hpp"
+#include "btpro/ip/prefix.hpp"
+#include "btpro/socket.hpp"
+#include "btpro/ev.hpp"
+
+#include <vector>
+#include <functional>
+
+#ifdef __linux__
+#include <netinet/tcp.h>
+#include <fstream>
+#include <sstream>
+#endif // __linux__
+
+namespace btpro {
+namespace tcp {
+
+// опции принятых сокетов, применяются сразу после accept пачкой
+// заданные значения, остальное наследуется от слушающего сокета
+class accept_options
+{
+    constexpr static auto unset = int{ -1 };
+
+    int nodelay_{unset};
+    int sndbuf_{unset};
+    int rcvbuf_{unset};
+    low_latency profile_{};
+    bool has_profile_{false};
+
+public:
+    accept_options() = default;
+
+    accept_options& nodelay(bool value = true) noexcept
+    {
+        nodelay_ = value;
+        return *this;
+    }
+
+    accept_options& sndbuf(int value) noexcept
+    {
+        sndbuf_ = value;
+        return *this;
+    }
+
+    accept_options& rcvbuf(int value) noexcept
+    {
+        rcvbuf_ = value;
+        return *this;
+    }
+
+    accept_options& set(const low_latency& profile) noexcept
+    {
+        profile_ = profile;
+        has_profile_ = true;
+        return *this;
+    }
+
+    bool empty() const noexcept
+    {
+        return (nodelay_ == unset) && (sndbuf_ == unset) &&
+            (rcvbuf_ == unset) && !has_profile_;
+    }
+
+    void apply(evutil_socket_t fd) const
+    {
+#ifdef TCP_NODELAY
+        if (nodelay_ != unset)
+            (nodelay_ ? tcp_nodelay::on() : tcp_nodelay::off()).apply(fd);
+#endif // TCP_NODELAY
+        if (sndbuf_ != unset)
+            sndbuf::size(sndbuf_).apply(fd);
+        if (rcvbuf_ != unset)
+            rcvbuf::size(rcvbuf_).apply(fd);
+        if (has_profile_)
+            profile_.apply(fd);
+    }
+};
+
+// принятое соединение, владение сокетом переходит к обработчику
+struct accepted
+{
+    socket sock{};
+    sock_addr addr{};
+};
+
+// пачка соединений одного события готовности
+class accept_batch
+{
+    accepted *data_{nullptr};
+    std::size_t size_{};
+
+public:
+    accept_batch() = default;
+
+    accept_batch(accepted *data, std::size_t size) noexcept
+        : data_(data)
+        , size_(size)
+    {   }
+
+    accepted* begin() const noexcept
+    {
+        return data_;
+    }
+
+    accepted* end() const noexcept
+    {
+        return data_ + size_;
+    }
+
+    accepted& operator[](std::size_t i) const noexcept
+    {
+        assert(i < size_);
+        return data_[i];
+    }
+
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    bool empty() const noexcept
+    {
+        return !size_;
+    }
+};
+
+// прием соединений пачками
+// за одно событие EV_READ забирает из очереди listen до max соединений,
+// применяет опции и передает всю пачку одним вызовом обработчика
+// evconnlistener вызывает обработчик на каждое соединение отдельно
+// при нехватке дескрипторов прием приостанавливается на pause
+class batch_acceptor
+{
+public:
+    typedef std::function<void(accept_batch)> handler_t;
+    typedef std::function<void(std::exception_ptr)> throw_t;
+
+    struct stat
+    {
+        std::uint64_t accepted{};
+        std::uint64_t batches{};
+        // пачка заполнена целиком, в очереди скорее всего остались еще
+        std::uint64_t full_batches{};
+        std::uint64_t max_batch{};
+        // EMFILE, ENFILE, ENOBUFS, ENOMEM
+        std::uint64_t fd_limit{};
+        std::uint64_t errors{};
+        // закрыты по acl
+        std::uint64_t denied{};
+        // закрыты по admission
+        std::uint64_t rejected{};
+        // очередь listen была полна при проверке после полной пачки
+        std::uint64_t queue_full{};
+    };
+
+    // очередь listen по TCP_INFO слушающего сокета
+    struct queue_info
+    {
+        std::uint32_t pending{};
+        std::uint32_t backlog{};
+    };
+
+private:
+    socket sock_{};
+    bool own_{false};
+    handler_t handler_{};
+    throw_t on_throw_{};
+    accept_options options_{};
+    std::vector<accepted> slot_{};
+    const ip::lpm<bool> *acl_{nullptr};
+    bool acl_default_{true};
+    admission *admission_{nullptr};
+    std::chrono::milliseconds pause_{100};
+    stat stat_{};
+    ev_stack event_{};
+    ev_stack resume_{};
+
+    template<class T>
+    struct proxy
+    {
+        static void evcb(evutil_socket_t, event_flag, void *obj) noexcept
+        {
+            assert(obj);
+            static_cast<T*>(obj)->dispatch();
+        }
+
+        static void resumecb(evutil_socket_t, event_flag, void *obj) noexcept
+        {
+            assert(obj);
+            static_cast<T*>(obj)->resume();
+        }
+    };
+
+    static bool fd_limit(int err) noexcept
+    {
+        return (err == EMFILE) || (err == ENFILE) ||
+            (err == ENOBUFS) || (err == ENOMEM);
+    }
+
+    evutil_socket_t accept_one(sock_addr& sa) noexcept
+    {
+        ev_socklen_t salen = sock_addr::capacity;
+#ifdef __linux__
+        auto fd = ::accept4(sock_.fd(), sa.sa(), &salen,
+            SOCK_NONBLOCK|SOCK_CLOEXEC);
+#else
+        auto fd = ::accept(sock_.fd(), sa.sa(), &salen);
+        if (fd != net::invalid)
+        {
+            evutil_make_socket_nonblocking(fd);
+            evutil_make_socket_closeonexec(fd);
+        }
+#endif // __linux__
+        if (fd != net::invalid)
+            sa.resize(salen);
+        return fd;
+    }
+
+    // дескрипторы кончились - соединения остаются в очереди
+    // и EV_READ сработает сразу же, поэтому ждем pause
+    void suspend()
+    {
+        event_.remove();
+        if (resume_.empty())
+            resume_.create(event_base_of(), -1, 0, proxy<batch_acceptor>::resumecb, this);
+        resume_.add(pause_);
+    }
+
+    void resume() noexcept
+    {
+        try
+        {
+            // прием остановлен admission, его и возобновит
+            if (admission_ && admission_->paused())
+                return;
+            event_.add();
+        }
+        catch (...)
+        {
+            on_throw(std::current_exception());
+        }
+    }
+
+    queue_pointer event_base_of() const noexcept
+    {
+        return event_get_base(event_.handle());
+    }
+
+    void dispatch() noexcept
+    {
+        std::size_t n = 0;
+        try
+        {
+            // каждый accept расходует пачку, даже отклоненный,
+            // иначе поток запрещенных адресов выберет всю очередь listen
+            for (std::size_t i = 0; i < slot_.size(); ++i)
+            {
+                // остальные подождут в очереди listen
+                if (admission_ && admission_->paused())
+                    break;
+
+                auto& slot = slot_[n];
+                auto fd = accept_one(slot.addr);
+                if (fd == net::invalid)
+                {
+                    auto err = net::error();
+                    if ((err == net::ewouldblock) || (err == net::eagain))
+                        break;
+                    if ((err == EINTR) || (err == ECONNABORTED))
+                        continue;
+
+                    if (fd_limit(err))
+                    {
+                        ++stat_.fd_limit;
+                        suspend();
+                    }
+                    else
+                        ++stat_.errors;
+                    break;
+                }
+
+                socket sock(fd);
+                if (acl_ && !acl_->allow(slot.addr, acl_default_))
+                {
+                    sock.close();
+                    ++stat_.denied;
+                    continue;
+                }
+
+                try
+                {
+                    options_.apply(fd);
+                }
+                catch (...)
+                {
+                    // соединение сброшено до настройки
+                    sock.close();
+                    ++stat_.errors;
+                    continue;
+                }
+
+                // учитываем только настроенное соединение
+                if (admission_ && (admission_->admit(slot.addr) != admission::accept))
+                {
+                    sock.close();
+                    ++stat_.rejected;
+                    continue;
+                }
+
+                slot.sock = sock;
+                ++n;
+            }
+
+            if (!n)
+                return;
+
+            ++stat_.batches;
+            stat_.accepted += n;
+            if (n > stat_.max_batch)
+                stat_.max_batch = n;
+
+            if (n == slot_.size())
+            {
+                ++stat_.full_batches;
+                auto q = queue();
+                if (q.backlog && (q.pending >= q.backlog))
+                    ++stat_.queue_full;
+            }
+
+            auto count = n;
+            n = 0;
+            handler_(accept_batch(slot_.data(), count));
+        }
+        catch (...)
+        {
+            // пачка не передана, сокеты закрываем
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                if (admission_)
+                    admission_->release(slot_[i].addr);
+                slot_[i].sock.close();
+            }
+            on_throw(std::current_exception());
+        }
+    }
+
+    void on_throw(std::exception_ptr ep) noexcept
+    {
+        try
+        {
+            if (on_throw_)
+                on_throw_(ep);
+        }
+        catch (...)
+        {   }
+    }
+
+    void start(queue_pointer queue, std::size_t max)
+    {
+        assert(queue && max && handler_);
+        slot_.resize(max);
+        event_.create(queue, sock_.fd(), EV_READ|EV_PERSIST,
+            proxy<batch_acceptor>::evcb, this);
+        event_.add();
+    }
+
+public:
+    // создает слушающий сокет с SO_REUSEADDR
+    batch_acceptor(queue_pointer queue, const ip::addr& sa, int backlog,
+        handler_t handler, std::size_t max = 64)
+        : own_(true)
+        , handler_(std::move(handler))
+    {
+        sock_.create(sa, sock_stream, reuse_addr::on());
+        try
+        {
+            sock_.listen(backlog);
+            start(queue, max);
+        }
+        catch (...)
+        {
+            sock_.close();
+            throw;
+        }
+    }
+
+    // уже слушающий неблокирующий сокет, владение не передается
+    batch_acceptor(queue_pointer queue, socket sock,
+        handler_t handler, std::size_t max = 64)
+        : sock_(sock)
+        , handler_(std::move(handler))
+    {
+        assert(sock.good());
+        start(queue, max);
+    }
+
+    batch_acceptor(const batch_acceptor&) = delete;
+    batch_acceptor& operator=(const batch_acceptor&) = delete;
+
+    ~batch_acceptor() noexcept
+    {
+        clear_admission();
+        if (!resume_.empty())
+            resume_.destroy();
+        event_.destroy();
+        if (own_)
+            sock_.close();
+    }
+
+    batch_acceptor& set(handler_t handler)
+    {
+        assert(handler);
+        handler_ = std::move(handler);
+        return *this;
+    }
+
+    batch_acceptor& set(throw_t handler)
+    {
+        on_throw_ = std::move(handler);
+        return *this;
+    }
+
+    batch_acceptor& set(const accept_options& options)
+    {
+        options_ = options;
+        return *this;
+    }
+
+    // адреса проверяются до обработчика, запрещенные сразу закрываются
+    // acl должна жить дольше batch_acceptor
+    batch_acceptor& set(const ip::lpm<bool>& acl, bool allow_default = true) noexcept
+    {
+        acl_ = &acl;
+        acl_default_ = allow_default;
+        return *this;
+    }
+
+    // ограничения приема, отклоненные соединения сразу закрываются
+    // принятые учтены в ctl, при их закрытии нужен ctl.release(addr)
+    // ctl должен жить дольше batch_acceptor
+    batch_acceptor& set(admission& ctl)
+    {
+        clear_admission();
+        admission_ = &ctl;
+        ctl.set(admission::pause_t([this](bool pause) {
+            (pause) ? event_.remove() : event_.add();
+        }));
+        return *this;
+    }
+
+    void clear_admission() noexcept
+    {
+        if (admission_)
+        {
+            admission_->set(admission::pause_t());
+            admission_ = nullptr;
+        }
+    }
+
+    // пауза приема при нехватке дескрипторов
+    batch_acceptor& set_pause(std::chrono::milliseconds pause) noexcept
+    {
+        pause_ = pause;
+        return *this;
+    }
+
+    void enable()
+    {
+        event_.add();
+    }
+
+    void disable()
+    {
+        event_.remove();
+        if (!resume_.empty())
+            resume_.remove();
+    }
+
+    socket sock() const noexcept
+    {
+        return sock_;
+    }
+
+    const stat& get_stat() const noexcept
+    {
+        return stat_;
+    }
+
+    // длина очереди принятых ядром соединений и ее предел
+    // нули - нет данных на этой платформе
+    queue_info queue() const noexcept
+    {
+        queue_info rc;
+#if defined(__linux__) && defined(TCP_INFO)
+        tcp_info info{};
+        socklen_t len = sizeof(info);
+        if (::getsockopt(sock_.fd(), IPPROTO_TCP, TCP_INFO, &info, &len) == 0)
+        {
+            // для слушающего сокета ядро отдает очередь в unacked/sacked
+            rc.pending = info.tcpi_unacked;
+            rc.backlog = info.tcpi_sacked;
+        }
+#endif
+        return rc;
+    }
+
+#ifdef __linux__
+    struct overflow
+    {
+        // TcpExt ListenOverflows и ListenDrops по всей системе
+        std::uint64_t overflows{};
+        std::uint64_t drops{};
+    };
+
+    // счетчики переполнения очередей listen из /proc/net/netstat
+    static overflow listen_overflows()
+    {
+        overflow rc;
+        std::ifstream in("/proc/net/netstat");
+        std::string names, values;
+        while (std::getline(in, names) && std::getline(in, values))
+        {
+            if (names.compare(0, 7, "TcpExt:") != 0)
+                continue;
+
+            std::istringstream n(names), v(values);
+            std::string name, value;
+            while ((n >> name) && (v >> value))
+            {
+                if (name == "ListenOverflows")
+                    rc.overflows = std::stoull(value);
+                else if (name == "ListenDrops")
+                    rc.drops = std::stoull(value);
+            }
+            break;
+        }
+        return rc;
+    }
+#endif // __linux__
+};
+
+} // namespace tcp
+} // namespace btpro
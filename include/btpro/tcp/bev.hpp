@@ -14,7 +14,7 @@ namespace tcp {
 
 typedef bufferevent* bufferevent_handle_t;
 
-template<class T>
+template<class T, auto... F>
 class bevfn;
 
 class bev
@@ -371,8 +371,14 @@ public:
         bufferevent_set_timeouts(assert_handle(), timeout_read, timeout_write);
     }
 
-    template<class T>
-    void set(bevfn<T>& val)
+    template<class T, auto... F>
+    void set(bevfn<T, F...>& val)
+    {
+        val.apply(*this);
+    }
+
+    template<class T, auto... F>
+    void set(const bevfn<T, F...>& val)
     {
         val.apply(*this);
     }
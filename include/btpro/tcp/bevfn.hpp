@@ -3,13 +3,19 @@
 #include "btpro/tcp/bev.hpp"
 
 #include <functional>
+#include <type_traits>
 
 namespace btpro {
 namespace tcp {
 
-template<class T>
+// обработчики задаются указателями на методы во время работы
+// bevfn<T, &T::recv, &T::send, &T::event> - связаны при компиляции
+template<class T, auto... F>
 class bevfn
 {
+    static_assert(sizeof...(F) == 0,
+        "bevfn<T, recv, send, event[, connect]>");
+
 public:
     typedef void (T::*on_data_t)();
     typedef void (T::*on_event_t)(short);
@@ -118,5 +124,67 @@ public:
     }
 };
 
+// методы - параметры шаблона, калбек вызывает их напрямую
+// без чтения указателей и косвенного вызова, компилятор встраивает
+// обработчик в калбек libevent, аргумент калбека - сам T
+// без C событие BEV_EVENT_CONNECTED уходит в E
+// методы могут быть noexcept
+template<class T, auto R, auto S, auto E, auto... C>
+class bevfn<T, R, S, E, C...>
+{
+    static_assert(sizeof...(C) <= 1,
+        "bevfn<T, recv, send, event[, connect]>");
+    static_assert(std::is_invocable_v<decltype(R), T&> &&
+        std::is_invocable_v<decltype(S), T&> &&
+        std::is_invocable_v<decltype(E), T&, short> &&
+        (std::is_invocable_v<decltype(C), T&> && ...),
+        "bevfn<T, void (T::*)(), void (T::*)(), void (T::*)(short)>");
+
+    T& self_;
+
+    static inline void recvcb(bufferevent *, void *self) noexcept
+    {
+        assert(self);
+        (static_cast<T*>(self)->*R)();
+    }
+
+    static inline void sendcb(bufferevent *, void *self) noexcept
+    {
+        assert(self);
+        (static_cast<T*>(self)->*S)();
+    }
+
+    static inline void evcb(bufferevent *, short what, void *self) noexcept
+    {
+        assert(self);
+        auto& obj = *static_cast<T*>(self);
+        if constexpr (sizeof...(C) != 0)
+        {
+            if (what == BEV_EVENT_CONNECTED)
+            {
+                ((obj.*C)(), ...);
+                return;
+            }
+        }
+        (obj.*E)(what);
+    }
+
+public:
+    explicit bevfn(T& self) noexcept
+        : self_(self)
+    {   }
+
+    static void apply(bufferevent_handle_t hbev, T& self) noexcept
+    {
+        assert(hbev);
+        bufferevent_setcb(hbev, &recvcb, &sendcb, &evcb, &self);
+    }
+
+    void apply(bufferevent_handle_t hbev) const noexcept
+    {
+        apply(hbev, self_);
+    }
+};
+
 } // namespace tcp
 } // namespace evnet
@@ -0,0 +1,371 @@
+#pragma once
+
+#include "btpro/tcp/bev.hpp"
+#include "btpro/sock_addr.hpp"
+
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+namespace btpro {
+namespace tcp {
+
+// заранее созданные слоты соединений
+// в слоте bufferevent, адрес клиента и состояние T
+// bufferevent создаются один раз и переключаются на новый сокет,
+// поэтому прием и закрытие соединения не создают bufferevent,
+// evbuffer и калбеки, T строится на месте в слоте
+// T обрабатывает события слота:
+//   void on_recv(conn&)
+//   void on_event(conn&, short)
+//   void on_send(conn&) - необязательно
+// после on_event с BEV_EVENT_EOF или BEV_EVENT_ERROR слот освобождается
+template<class T>
+class conn_slab
+{
+public:
+    // номер слота и поколение, после закрытия handle недействителен
+    struct handle
+    {
+        std::uint32_t index{};
+        std::uint32_t gen{};
+
+        explicit operator bool() const noexcept
+        {
+            return gen != 0;
+        }
+
+        std::uint64_t value() const noexcept
+        {
+            return (std::uint64_t{gen} << 32) | index;
+        }
+
+        static handle from(std::uint64_t value) noexcept
+        {
+            return { static_cast<std::uint32_t>(value),
+                static_cast<std::uint32_t>(value >> 32) };
+        }
+
+        bool operator==(const handle& other) const noexcept
+        {
+            return (index == other.index) && (gen == other.gen);
+        }
+
+        bool operator!=(const handle& other) const noexcept
+        {
+            return !(*this == other);
+        }
+    };
+
+    class conn
+    {
+        friend class conn_slab;
+
+        conn_slab *slab_{nullptr};
+        std::uint32_t index_{};
+        // нечетное - слот занят
+        std::uint32_t gen_{};
+        std::uint32_t next_{};
+        tcp::bev bev_{};
+        sock_addr peer_{};
+        std::optional<T> state_{};
+
+    public:
+        conn() = default;
+        conn(const conn&) = delete;
+        conn& operator=(const conn&) = delete;
+
+        tcp::bev& bev() noexcept
+        {
+            return bev_;
+        }
+
+        const sock_addr& peer() const noexcept
+        {
+            return peer_;
+        }
+
+        T& state() noexcept
+        {
+            assert(state_);
+            return *state_;
+        }
+
+        handle id() const noexcept
+        {
+            return { index_, gen_ };
+        }
+
+        bool busy() const noexcept
+        {
+            return (gen_ & 1) != 0;
+        }
+
+        // освободить слот, можно из обработчика
+        void close() noexcept
+        {
+            assert(slab_);
+            slab_->close(*this);
+        }
+    };
+
+    struct stat
+    {
+        std::size_t capacity{};
+        std::size_t active{};
+        std::size_t peak{};
+        std::uint64_t opened{};
+        std::uint64_t closed{};
+        // нет свободного слота
+        std::uint64_t full{};
+    };
+
+private:
+    constexpr static auto npos = ~std::uint32_t{};
+
+    std::unique_ptr<conn[]> slot_{};
+    std::uint32_t free_{npos};
+    stat stat_{};
+
+    template<class A, class = void>
+    struct has_on_send
+        : std::false_type
+    {   };
+
+    template<class A>
+    struct has_on_send<A, std::void_t<
+        decltype(std::declval<A&>().on_send(std::declval<conn&>()))>>
+        : std::true_type
+    {   };
+
+    template<class A>
+    struct proxy
+    {
+        static void recvcb(bufferevent *, void *obj) noexcept
+        {
+            assert(obj);
+            auto& c = *static_cast<conn*>(obj);
+            if (c.state_)
+                c.state_->on_recv(c);
+        }
+
+        static void sendcb(bufferevent *, void *obj) noexcept
+        {
+            assert(obj);
+            auto& c = *static_cast<conn*>(obj);
+            if (c.state_)
+                c.state_->on_send(c);
+        }
+
+        static void evcb(bufferevent *, short what, void *obj) noexcept
+        {
+            assert(obj);
+            auto& c = *static_cast<conn*>(obj);
+            if (!c.state_)
+                return;
+
+            auto gen = c.gen_;
+            c.state_->on_event(c, what);
+            // обработчик мог закрыть слот, а новый прием занять его
+            if ((what & (BEV_EVENT_EOF|BEV_EVENT_ERROR)) && (gen == c.gen_))
+                c.slab_->close(c);
+        }
+    };
+
+    static bufferevent_data_cb send_callback() noexcept
+    {
+        if constexpr (has_on_send<T>::value)
+            return &proxy<T>::sendcb;
+        else
+            return nullptr;
+    }
+
+    conn* lookup(handle h) const noexcept
+    {
+        if (!h || (h.index >= stat_.capacity))
+            return nullptr;
+
+        auto& c = slot_[h.index];
+        return (c.busy() && (c.gen_ == h.gen)) ? &c : nullptr;
+    }
+
+    // вернуть bufferevent в исходное состояние
+    static void reset(bufferevent *hbev) noexcept
+    {
+        bufferevent_disable(hbev, EV_READ|EV_WRITE);
+        bufferevent_set_timeouts(hbev, nullptr, nullptr);
+        bufferevent_setwatermark(hbev, EV_READ|EV_WRITE, 0, 0);
+
+        auto input = bufferevent_get_input(hbev);
+        evbuffer_drain(input, evbuffer_get_length(input));
+        auto output = bufferevent_get_output(hbev);
+        evbuffer_drain(output, evbuffer_get_length(output));
+
+        auto fd = bufferevent_getfd(hbev);
+        bufferevent_setfd(hbev, -1);
+        if (fd != -1)
+            evutil_closesocket(fd);
+    }
+
+    void close(conn& c) noexcept
+    {
+        if (!c.busy())
+            return;
+
+        // сначала поколение, старые handle сразу недействительны
+        ++c.gen_;
+        reset(c.bev_.handle());
+        c.state_.reset();
+
+        c.next_ = free_;
+        free_ = c.index_;
+        --stat_.active;
+        ++stat_.closed;
+    }
+
+public:
+    // opt - опции bufferevent, BEV_OPT_CLOSE_ON_FREE не нужен
+    // BEV_OPT_DEFER_CALLBACKS запрещен: отложенный калбек прошлого сокета
+    // reset не отменяет, и он дошел бы до следующего соединения в слоте
+    conn_slab(queue_handle_t queue, std::size_t capacity, int opt = 0)
+    {
+        assert(queue && capacity && (capacity < npos));
+        assert(!(opt & BEV_OPT_CLOSE_ON_FREE));
+        if (opt & (BEV_OPT_DEFER_CALLBACKS|BEV_OPT_UNLOCK_CALLBACKS))
+            throw std::runtime_error("conn_slab deferred callbacks");
+
+        slot_.reset(new conn[capacity]);
+
+        stat_.capacity = capacity;
+        // свободные слоты выдаются по возрастанию номера
+        for (auto i = capacity; i-- > 0; )
+        {
+            auto& c = slot_[i];
+            c.slab_ = this;
+            c.index_ = static_cast<std::uint32_t>(i);
+            c.bev_.create(queue, opt);
+            c.bev_.set(&proxy<T>::recvcb, send_callback(),
+                &proxy<T>::evcb, &c);
+            c.next_ = free_;
+            free_ = c.index_;
+        }
+    }
+
+    conn_slab(const conn_slab&) = delete;
+    conn_slab& operator=(const conn_slab&) = delete;
+
+    ~conn_slab() noexcept
+    {
+        close_all();
+    }
+
+    // слот для принятого сокета, владение сокетом переходит к слоту
+    // args - для конструктора T
+    // нет свободных слотов - сокет закрывается, handle пустой
+    template<class... A>
+    handle open(socket sock, const ip::addr& peer, A&&... args)
+    {
+        assert(sock.good());
+
+        if (free_ == npos)
+        {
+            sock.close();
+            ++stat_.full;
+            return handle();
+        }
+
+        auto& c = slot_[free_];
+        free_ = c.next_;
+        ++c.gen_;
+        ++stat_.active;
+        ++stat_.opened;
+        if (stat_.active > stat_.peak)
+            stat_.peak = stat_.active;
+
+        try
+        {
+            c.peer_.assign(peer);
+            c.bev_.set(sock);
+            c.state_.emplace(std::forward<A>(args)...);
+            c.bev_.enable(EV_READ|EV_WRITE);
+        }
+        catch (...)
+        {
+            if (c.bev_.fd() == -1)
+                sock.close();
+            close(c);
+            throw;
+        }
+
+        return c.id();
+    }
+
+    // nullptr - соединение уже закрыто
+    conn* get(handle h) noexcept
+    {
+        return lookup(h);
+    }
+
+    const conn* get(handle h) const noexcept
+    {
+        return lookup(h);
+    }
+
+    bool close(handle h) noexcept
+    {
+        auto c = lookup(h);
+        if (!c)
+            return false;
+
+        close(*c);
+        return true;
+    }
+
+    void close_all() noexcept
+    {
+        for (std::size_t i = 0; i < stat_.capacity; ++i)
+            close(slot_[i]);
+    }
+
+    // fn(conn&) для занятых слотов
+    template<class F>
+    void for_each(F fn)
+    {
+        for (std::size_t i = 0; i < stat_.capacity; ++i)
+        {
+            auto& c = slot_[i];
+            if (c.busy())
+                fn(c);
+        }
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return stat_.capacity;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return stat_.active;
+    }
+
+    bool full() const noexcept
+    {
+        return free_ == npos;
+    }
+
+    // занятость 0..1
+    double occupancy() const noexcept
+    {
+        return static_cast<double>(stat_.active) /
+            static_cast<double>(stat_.capacity);
+    }
+
+    const stat& get_stat() const noexcept
+    {
+        return stat_;
+    }
+};
+
+} // namespace tcp
+} // namespace btpro
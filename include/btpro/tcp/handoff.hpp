@@ -0,0 +1,664 @@
+#pragma once
+
+#include "btpro/tcp/bev.hpp"
+#include "btpro/socket.hpp"
+#include "btpro/ev.hpp"
+
+#ifndef _WIN32
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <chrono>
+
+namespace btpro {
+namespace tcp {
+
+// сокет для передачи новому процессу
+struct handoff_item
+{
+    enum kind_t : std::uint32_t
+    {
+        listener = 1,
+        connection = 2
+    };
+
+    std::uint32_t kind{listener};
+    // метка приложения, например номер порта из конфигурации
+    std::uint32_t tag{};
+    evutil_socket_t fd{-1};
+    // непрочитанные приложением данные соединения
+    std::string input{};
+    // неотправленные данные соединения
+    std::string output{};
+};
+
+// горячий перезапуск
+// старый процесс слушает unix сокет, новый подключается и получает
+// слушающие сокеты и, при желании, соединения с их буферами через SCM_RIGHTS
+// дескрипторы дублируются ядром, старый процесс после передачи
+// закрывает свои копии, очередь listen и соединения при этом сохраняются
+// обмен блокирующий, перезапуск случается редко, время ограничено timeout
+// формат в порядке байт машины, оба процесса на одном хосте
+// подключившийся получает все сокеты, поэтому его надо проверять (peer):
+// у файла сокета есть права доступа, а к абстрактному имени "@name"
+// может подключиться любой процесс в том же network namespace
+class handoff
+{
+    constexpr static std::uint32_t magic = 0x4f485442; // BTHO
+    constexpr static std::uint32_t version = 1;
+    constexpr static std::size_t chunk = socket::max_fds;
+
+    struct head
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t count;
+        std::uint32_t reserved;
+    };
+
+    struct entry
+    {
+        std::uint32_t kind;
+        std::uint32_t tag;
+        std::uint32_t input;
+        std::uint32_t output;
+    };
+
+    static local::addr make_addr(const std::string& path)
+    {
+        local::addr sa(path);
+        if (sa.unnamed())
+            throw std::runtime_error("handoff path: " + path);
+        return sa;
+    }
+
+    static void write_all(evutil_socket_t fd, const void *data, std::size_t size)
+    {
+        auto ptr = static_cast<const char*>(data);
+        while (size)
+        {
+            auto rc = ::send(fd, ptr, size, nosignal);
+            if (rc == code::fail)
+            {
+                if (net::error() == EINTR)
+                    continue;
+                throw std::system_error(net::error_code(), "handoff send");
+            }
+
+            ptr += rc;
+            size -= static_cast<std::size_t>(rc);
+        }
+    }
+
+    static void read_all(evutil_socket_t fd, void *data, std::size_t size)
+    {
+        auto ptr = static_cast<char*>(data);
+        while (size)
+        {
+            auto rc = ::recv(fd, ptr, size, 0);
+            if (rc == code::fail)
+            {
+                if (net::error() == EINTR)
+                    continue;
+                throw std::system_error(net::error_code(), "handoff recv");
+            }
+
+            if (!rc)
+                throw std::runtime_error("handoff peer closed");
+
+            ptr += rc;
+            size -= static_cast<std::size_t>(rc);
+        }
+    }
+
+    // первый байт идет вместе с дескрипторами
+    static void send_fds(socket sock, const evutil_socket_t *fds,
+        std::size_t count, std::uint32_t value)
+    {
+        assert(count && (count <= chunk));
+
+        while (sock.send_fds(reinterpret_cast<const char*>(&value),
+            sizeof(value), fds, count, nosignal) == code::fail)
+        {
+            if (net::error() != EINTR)
+                throw std::system_error(net::error_code(), "handoff sendmsg");
+        }
+    }
+
+    // принятые дескрипторы добавляются в fds
+    static std::uint32_t recv_fds(socket sock,
+        std::vector<evutil_socket_t>& fds)
+    {
+        std::uint32_t value{};
+        evutil_socket_t buf[chunk];
+        std::size_t count;
+        bool truncated;
+
+        ev_ssize_t rc;
+        do
+        {
+            count = chunk;
+            rc = sock.recv_fds(reinterpret_cast<char*>(&value),
+                sizeof(value), buf, count, truncated);
+        } while ((rc == code::fail) && (net::error() == EINTR));
+
+        fds.insert(fds.end(), buf, buf + count);
+
+        if (rc == code::fail)
+            throw std::system_error(net::error_code(), "handoff recvmsg");
+
+        if (truncated)
+            throw std::runtime_error("handoff control truncated");
+
+        if (!rc)
+            throw std::runtime_error("handoff peer closed");
+
+        // остаток значения без дескрипторов
+        if (static_cast<std::size_t>(rc) < sizeof(value))
+        {
+            read_all(sock.fd(), reinterpret_cast<char*>(&value) + rc,
+                sizeof(value) - static_cast<std::size_t>(rc));
+        }
+
+        return value;
+    }
+
+#ifdef MSG_NOSIGNAL
+    constexpr static int nosignal = MSG_NOSIGNAL;
+#else
+    constexpr static int nosignal = 0;
+#endif // MSG_NOSIGNAL
+
+public:
+    // предел ожидания одного send или recv обмена
+    constexpr static std::chrono::milliseconds default_timeout{5000};
+
+    // учетные данные процесса на другом конце сокета
+    struct peer_cred
+    {
+        pid_t pid{-1};
+        uid_t uid{};
+        gid_t gid{};
+    };
+
+    // pid известен только в linux
+    static peer_cred peer(socket sock)
+    {
+        peer_cred rc;
+#ifdef SO_PEERCRED
+        ucred cred{};
+        socklen_t len = sizeof(cred);
+        if (::getsockopt(sock.fd(), SOL_SOCKET, SO_PEERCRED, &cred, &len) == code::fail)
+            throw std::system_error(net::error_code(), "handoff peer");
+        rc.pid = cred.pid;
+        rc.uid = cred.uid;
+        rc.gid = cred.gid;
+#else
+        if (::getpeereid(sock.fd(), &rc.uid, &rc.gid) == code::fail)
+            throw std::system_error(net::error_code(), "handoff peer");
+#endif // SO_PEERCRED
+        return rc;
+    }
+
+    // ограничить время блокирующих send и recv
+    static void set_timeout(socket sock, std::chrono::milliseconds timeout)
+    {
+        auto tv = make_timeval(timeout);
+        if ((::setsockopt(sock.fd(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == code::fail) ||
+            (::setsockopt(sock.fd(), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == code::fail))
+        {
+            throw std::system_error(net::error_code(), "handoff timeout");
+        }
+    }
+
+    // слушать path в старом процессе, старый файл сокета удаляется
+    // path - как у local::addr, "@name" - абстрактное имя
+    // сокет неблокирующий, для очереди старого процесса
+    static socket listen(const std::string& path, int backlog = 1)
+    {
+        auto sa = make_addr(path);
+        sa.unlink();
+
+        socket sock;
+        sock.create(sa.family(), SOCK_STREAM);
+        try
+        {
+            sock.bind(sa);
+            sock.listen(backlog);
+        }
+        catch (...)
+        {
+            sock.close();
+            throw;
+        }
+        return sock;
+    }
+
+    // подключение нового процесса, блокирующий сокет
+    static socket connect(const std::string& path,
+        std::chrono::milliseconds timeout = default_timeout)
+    {
+        auto sa = make_addr(path);
+        auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == net::invalid)
+            throw std::system_error(net::error_code(), "handoff socket");
+
+        evutil_make_socket_closeonexec(fd);
+        while (::connect(fd, sa.sa(), sa.size()) == code::fail)
+        {
+            if (net::error() != EINTR)
+            {
+                auto ec = net::error_code();
+                evutil_closesocket(fd);
+                throw std::system_error(ec, "handoff connect");
+            }
+        }
+
+        socket sock(fd);
+        try
+        {
+            set_timeout(sock, timeout);
+        }
+        catch (...)
+        {
+            sock.close();
+            throw;
+        }
+        return sock;
+    }
+
+    // принять новый процесс на сокете из listen, блокирующий сокет
+    // учетные данные подключившегося проверяет вызывающий, см. peer
+    static socket accept(socket listener,
+        std::chrono::milliseconds timeout = default_timeout)
+    {
+        evutil_socket_t fd;
+        while ((fd = ::accept(listener.fd(), nullptr, nullptr)) == net::invalid)
+        {
+            if (net::error() != EINTR)
+                throw std::system_error(net::error_code(), "handoff accept");
+        }
+
+        evutil_make_socket_closeonexec(fd);
+        int flags = ::fcntl(fd, F_GETFL);
+        if (flags != code::fail)
+            ::fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+
+        socket sock(fd);
+        try
+        {
+            set_timeout(sock, timeout);
+        }
+        catch (...)
+        {
+            sock.close();
+            throw;
+        }
+        return sock;
+    }
+
+    // передать сокеты, дескрипторы items остаются открытыми у вызывающего
+    static void send(socket peer, const std::vector<handoff_item>& items)
+    {
+        assert(peer.good());
+
+        head h{ magic, version,
+            static_cast<std::uint32_t>(items.size()), 0 };
+        write_all(peer.fd(), &h, sizeof(h));
+
+        std::vector<entry> entries;
+        std::vector<evutil_socket_t> fds;
+        for (std::size_t i = 0; i < items.size(); i += chunk)
+        {
+            auto count = std::min(chunk, items.size() - i);
+            entries.clear();
+            fds.clear();
+            for (std::size_t j = i; j < i + count; ++j)
+            {
+                auto& item = items[j];
+                assert(item.fd != net::invalid);
+                if ((item.input.size() > UINT32_MAX) ||
+                    (item.output.size() > UINT32_MAX))
+                {
+                    throw std::runtime_error("handoff buffer too large");
+                }
+
+                entries.push_back({ item.kind, item.tag,
+                    static_cast<std::uint32_t>(item.input.size()),
+                    static_cast<std::uint32_t>(item.output.size()) });
+                fds.push_back(item.fd);
+            }
+
+            send_fds(peer, fds.data(), count,
+                static_cast<std::uint32_t>(count));
+            write_all(peer.fd(), entries.data(), entries.size() * sizeof(entry));
+        }
+
+        for (auto& item : items)
+        {
+            write_all(peer.fd(), item.input.data(), item.input.size());
+            write_all(peer.fd(), item.output.data(), item.output.size());
+        }
+    }
+
+    // получить сокеты, при ошибке полученные дескрипторы закрываются
+    static std::vector<handoff_item> recv(socket peer)
+    {
+        assert(peer.good());
+
+        std::vector<handoff_item> items;
+        std::vector<evutil_socket_t> fds;
+        try
+        {
+            head h{};
+            read_all(peer.fd(), &h, sizeof(h));
+            if ((h.magic != magic) || (h.version != version))
+                throw std::runtime_error("handoff protocol");
+
+            std::vector<entry> entries;
+            while (items.size() < h.count)
+            {
+                auto before = fds.size();
+                auto count = recv_fds(peer, fds);
+                if (!count || (count > chunk) ||
+                    (fds.size() - before != count) ||
+                    (items.size() + count > h.count))
+                {
+                    throw std::runtime_error("handoff protocol");
+                }
+
+                entries.resize(count);
+                read_all(peer.fd(), entries.data(), count * sizeof(entry));
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    handoff_item item;
+                    item.kind = entries[i].kind;
+                    item.tag = entries[i].tag;
+                    item.fd = fds[before + i];
+                    item.input.resize(entries[i].input);
+                    item.output.resize(entries[i].output);
+                    items.push_back(std::move(item));
+                }
+            }
+
+            for (auto& item : items)
+            {
+                read_all(peer.fd(), item.input.data(), item.input.size());
+                read_all(peer.fd(), item.output.data(), item.output.size());
+            }
+        }
+        catch (...)
+        {
+            for (auto fd : fds)
+                evutil_closesocket(fd);
+            throw;
+        }
+
+        return items;
+    }
+
+    // забрать соединение из bev: события отключаются, буферы копируются
+    // после send старый процесс освобождает bev, FIN не уходит
+    // пока дескриптор открыт в новом процессе
+    static handoff_item capture(bev& conn, std::uint32_t tag = 0)
+    {
+        conn.disable(EV_READ|EV_WRITE);
+
+        handoff_item item;
+        item.kind = handoff_item::connection;
+        item.tag = tag;
+        item.fd = conn.fd();
+
+        auto copy = [](evbuffer *buf, std::string& out) {
+            out.resize(evbuffer_get_length(buf));
+            if (out.empty())
+                return;
+
+            auto rc = evbuffer_copyout(buf, out.data(), out.size());
+            if (rc != static_cast<ev_ssize_t>(out.size()))
+                throw std::runtime_error("evbuffer_copyout");
+        };
+        copy(bufferevent_get_input(conn), item.input);
+
+        // начало выходного буфера заморожено, из него читает только bufferevent
+        auto output = bufferevent_get_output(conn);
+        evbuffer_unfreeze(output, 1);
+        try
+        {
+            copy(output, item.output);
+        }
+        catch (...)
+        {
+            evbuffer_freeze(output, 1);
+            throw;
+        }
+        evbuffer_freeze(output, 1);
+        return item;
+    }
+
+    // восстановить буферы соединения в новом bev
+    // входные данные уже в буфере, калбек чтения на них не сработает
+    // их надо обработать сразу после restore
+    static void restore(bev& conn, const handoff_item& item)
+    {
+        assert(item.kind == handoff_item::connection);
+
+        if (!item.input.empty())
+        {
+            // конец входного буфера заморожен, в него пишет только bufferevent
+            auto input = bufferevent_get_input(conn);
+            evbuffer_unfreeze(input, 0);
+            auto rc = evbuffer_add(input, item.input.data(), item.input.size());
+            evbuffer_freeze(input, 0);
+            detail::check_result("evbuffer_add", rc);
+        }
+
+        if (!item.output.empty())
+            conn.write(item.output.data(), item.output.size());
+    }
+};
+
+// старый процесс ждет нового на unix сокете в своей очереди
+// handler получает блокирующий сокет нового процесса и вызывает handoff::send
+// по умолчанию принимается только процесс с тем же euid,
+// остальные закрываются и попадают в обработчик исключений
+// обмен идет в очереди старого процесса, timeout ограничивает
+// каждый send и recv, чтобы зависший клиент не остановил очередь
+class handoff_server
+{
+public:
+    typedef std::function<void(socket)> handler_t;
+    typedef std::function<void(std::exception_ptr)> throw_t;
+    // true - процессу можно отдать сокеты
+    typedef std::function<bool(const handoff::peer_cred&)> verify_t;
+
+private:
+    socket sock_{};
+    local::addr addr_{};
+    handler_t handler_{};
+    throw_t on_throw_{};
+    verify_t verify_{};
+    std::chrono::milliseconds timeout_{handoff::default_timeout};
+    ev_stack event_{};
+
+    bool allow(const handoff::peer_cred& cred) const
+    {
+        return (verify_) ? verify_(cred) : (cred.uid == ::geteuid());
+    }
+
+    template<class T>
+    struct proxy
+    {
+        static void evcb(evutil_socket_t, event_flag, void *obj) noexcept
+        {
+            assert(obj);
+            static_cast<T*>(obj)->dispatch();
+        }
+    };
+
+    void dispatch() noexcept
+    {
+        try
+        {
+            auto peer = handoff::accept(sock_, timeout_);
+            socket::guard g(peer);
+            if (!allow(handoff::peer(peer)))
+                throw std::runtime_error("handoff peer rejected");
+            handler_(peer);
+        }
+        catch (...)
+        {
+            try
+            {
+                if (on_throw_)
+                    on_throw_(std::current_exception());
+            }
+            catch (...)
+            {   }
+        }
+    }
+
+public:
+    handoff_server(queue_pointer queue, std::string path, handler_t handler)
+        : sock_(handoff::listen(path))
+        , addr_(path)
+        , handler_(std::move(handler))
+    {
+        assert(queue && handler_);
+        try
+        {
+            event_.create(queue, sock_.fd(), EV_READ|EV_PERSIST,
+                proxy<handoff_server>::evcb, this);
+            event_.add();
+        }
+        catch (...)
+        {
+            sock_.close();
+            addr_.unlink();
+            throw;
+        }
+    }
+
+    handoff_server(const handoff_server&) = delete;
+    handoff_server& operator=(const handoff_server&) = delete;
+
+    ~handoff_server() noexcept
+    {
+        event_.destroy();
+        sock_.close();
+        addr_.unlink();
+    }
+
+    handoff_server& set(throw_t handler)
+    {
+        on_throw_ = std::move(handler);
+        return *this;
+    }
+
+    // своя проверка подключившегося вместо сравнения euid
+    handoff_server& set(verify_t fn)
+    {
+        verify_ = std::move(fn);
+        return *this;
+    }
+
+    handoff_server& set(std::chrono::milliseconds timeout)
+    {
+        assert(timeout.count() > 0);
+        timeout_ = timeout;
+        return *this;
+    }
+};
+
+// плавное завершение старого процесса
+// раз в poll проверяет число активных соединений
+// done(true) - все закрыты, done(false) - вышел timeout
+// без done очередь останавливается через loopexit
+class drain
+{
+public:
+    typedef std::function<std::size_t()> active_t;
+    typedef std::function<void(bool)> done_t;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    active_t active_{};
+    done_t done_{};
+    clock::time_point deadline_{};
+    std::chrono::milliseconds poll_{};
+    ev_stack timer_{};
+
+    template<class T>
+    struct proxy
+    {
+        static void evcb(evutil_socket_t, event_flag, void *obj) noexcept
+        {
+            assert(obj);
+            static_cast<T*>(obj)->check();
+        }
+    };
+
+    void finish(bool clean) noexcept
+    {
+        try
+        {
+            if (done_)
+                done_(clean);
+            else
+                event_base_loopexit(event_get_base(timer_.handle()), nullptr);
+        }
+        catch (...)
+        {   }
+    }
+
+    void check() noexcept
+    {
+        try
+        {
+            if (!active_())
+                return finish(true);
+
+            if (clock::now() >= deadline_)
+                return finish(false);
+
+            timer_.add(poll_);
+        }
+        catch (...)
+        {
+            finish(false);
+        }
+    }
+
+public:
+    drain(queue_pointer queue, active_t active,
+        std::chrono::milliseconds timeout, done_t done = done_t(),
+        std::chrono::milliseconds poll = std::chrono::milliseconds(50))
+        : active_(std::move(active))
+        , done_(std::move(done))
+        , deadline_(clock::now() + timeout)
+        , poll_(poll)
+    {
+        assert(queue && active_ && (poll.count() > 0));
+        timer_.create(queue, -1, 0, proxy<drain>::evcb, this);
+        timer_.add(std::chrono::milliseconds(0));
+    }
+
+    drain(const drain&) = delete;
+    drain& operator=(const drain&) = delete;
+
+    ~drain() noexcept
+    {
+        timer_.destroy();
+    }
+};
+
+} // namespace tcp
+} // namespace btpro
+
+#endif // _WIN32
@@ -85,6 +85,24 @@ public:
         listen(queue, 0, -1, sa, cb, arg);
     }
 
+    // уже слушающий сокет, например полученный через handoff
+    // владение сокетом переходит к listener
+    void listen(queue_handle_t queue, unsigned int flags,
+        socket sock, evconnlistener_cb cb, void *arg)
+    {
+        assert(queue && sock.good());
+
+        // backlog 0 - listen уже вызван
+        auto result = evconnlistener_new(queue, cb, arg,
+            flags|LEV_OPT_CLOSE_ON_FREE, 0, sock.fd());
+        if (!result)
+        {
+            sock.close();
+            throw std::runtime_error("evconnlistener_new");
+        }
+        handle_.reset(result);
+    }
+
     void swap(listener& other) noexcept
     {
         assert(this != &other);
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "btpro/sock_opt.hpp"
+
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#endif // __linux__
+
+namespace btpro {
+
+// отметки времени пакета
+// software - ядро, hardware - сетевая карта
+// нулевые если отметка не пришла
+struct packet_stamp
+{
+    timespec software{};
+    timespec hardware{};
+
+    bool has_software() const noexcept
+    {
+        return (software.tv_sec != 0) || (software.tv_nsec != 0);
+    }
+
+    bool has_hardware() const noexcept
+    {
+        return (hardware.tv_sec != 0) || (hardware.tv_nsec != 0);
+    }
+};
+
+#ifdef SO_TIMESTAMPING
+
+// отметка отправки из очереди ошибок сокета
+struct tx_stamp
+{
+    packet_stamp stamp{};
+    // номер пакета при timestamping::opt_id
+    std::uint32_t key{};
+    // SCM_TSTAMP_SND, SCM_TSTAMP_SCHED или SCM_TSTAMP_ACK
+    std::uint32_t type{};
+};
+
+namespace timestamping {
+
+constexpr static auto rx_software = int{
+    SOF_TIMESTAMPING_RX_SOFTWARE|SOF_TIMESTAMPING_SOFTWARE
+};
+
+// сетевая карта должна быть настроена через SIOCSHWTSTAMP
+constexpr static auto rx_hardware = int{
+    SOF_TIMESTAMPING_RX_HARDWARE|SOF_TIMESTAMPING_RAW_HARDWARE
+};
+
+constexpr static auto tx_software = int{
+    SOF_TIMESTAMPING_TX_SOFTWARE|SOF_TIMESTAMPING_SOFTWARE
+};
+
+constexpr static auto tx_hardware = int{
+    SOF_TIMESTAMPING_TX_HARDWARE|SOF_TIMESTAMPING_RAW_HARDWARE
+};
+
+// пакет поставлен в очередь qdisc
+constexpr static auto tx_sched = int{ SOF_TIMESTAMPING_TX_SCHED };
+
+// tcp: все данные подтверждены
+constexpr static auto tx_ack = int{ SOF_TIMESTAMPING_TX_ACK };
+
+// нумерация пакетов в tx_stamp::key
+// и без копии пакета в очереди ошибок
+constexpr static auto opt_id = int{
+    SOF_TIMESTAMPING_OPT_ID|SOF_TIMESTAMPING_OPT_TSONLY
+};
+
+constexpr static std::size_t control_size =
+    CMSG_SPACE(sizeof(scm_timestamping));
+
+namespace detail {
+    static const char name[] = "SO_TIMESTAMPING";
+    typedef sock_basic_option<int, SOL_SOCKET, SO_TIMESTAMPING> type;
+} // namespace detail
+
+static inline detail::type flags(int value) noexcept
+{
+    return detail::type(value, detail::name);
+}
+
+static inline detail::type off() noexcept
+{
+    return detail::type(0, detail::name);
+}
+
+// разбор SCM_TIMESTAMPING и SCM_TIMESTAMPNS
+// false - cmsg не содержит отметок
+static inline bool parse(const cmsghdr *cmsg, packet_stamp& stamp) noexcept
+{
+    assert(cmsg);
+
+    if (cmsg->cmsg_level != SOL_SOCKET)
+        return false;
+
+    if (cmsg->cmsg_type == SCM_TIMESTAMPING)
+    {
+        scm_timestamping ts;
+        std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+        // ts[1] устарел и не заполняется
+        if ((ts.ts[0].tv_sec != 0) || (ts.ts[0].tv_nsec != 0))
+            stamp.software = ts.ts[0];
+        if ((ts.ts[2].tv_sec != 0) || (ts.ts[2].tv_nsec != 0))
+            stamp.hardware = ts.ts[2];
+        return true;
+    }
+
+#ifdef SCM_TIMESTAMPNS
+    if (cmsg->cmsg_type == SCM_TIMESTAMPNS)
+    {
+        std::memcpy(&stamp.software, CMSG_DATA(cmsg), sizeof(timespec));
+        return true;
+    }
+#endif // SCM_TIMESTAMPNS
+
+    return false;
+}
+
+static inline void parse(msghdr& msg, packet_stamp& stamp) noexcept
+{
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        parse(cmsg, stamp);
+    }
+}
+
+// разбор сообщения из MSG_ERRQUEUE
+// false - сообщение не является отметкой отправки
+static inline bool parse(msghdr& msg, tx_stamp& stamp) noexcept
+{
+    bool has_stamp = false;
+    bool has_origin = false;
+
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (parse(cmsg, stamp.stamp))
+        {
+            has_stamp = true;
+            continue;
+        }
+
+        auto recverr =
+            ((cmsg->cmsg_level == IPPROTO_IP) &&
+                (cmsg->cmsg_type == IP_RECVERR)) ||
+            ((cmsg->cmsg_level == IPPROTO_IPV6) &&
+                (cmsg->cmsg_type == IPV6_RECVERR));
+
+        if (recverr)
+        {
+            sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING)
+            {
+                stamp.key = err.ee_data;
+                stamp.type = err.ee_info;
+                has_origin = true;
+            }
+        }
+    }
+
+    return has_stamp && has_origin;
+}
+
+} // namespace timestamping
+#endif // SO_TIMESTAMPING
+
+} // namespace btpro
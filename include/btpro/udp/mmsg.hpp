@@ -0,0 +1,546 @@
+#pragma once
+
+#include "btpro/udp/udp.hpp"
+#include "btpro/sock_addr.hpp"
+#include "btpro/socket.hpp"
+
+#ifdef __linux__
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <string_view>
+
+namespace btpro {
+namespace udp {
+
+// разбивка склеенного буфера (UDP_GRO) на датаграммы
+// все сегменты кроме последнего имеют размер segment_size
+class segments
+{
+    const char* data_{nullptr};
+    std::size_t size_{};
+    std::size_t segment_size_{};
+
+public:
+    class iterator
+    {
+        const char* ptr_{nullptr};
+        const char* end_{nullptr};
+        std::size_t step_{};
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string_view*;
+        using reference = std::string_view;
+
+        iterator() = default;
+
+        iterator(const char* ptr, const char* end, std::size_t step) noexcept
+            : ptr_(ptr)
+            , end_(end)
+            , step_(step)
+        {   }
+
+        std::string_view operator*() const noexcept
+        {
+            auto left = static_cast<std::size_t>(end_ - ptr_);
+            return std::string_view(ptr_, (std::min)(left, step_));
+        }
+
+        iterator& operator++() noexcept
+        {
+            auto left = static_cast<std::size_t>(end_ - ptr_);
+            ptr_ += (std::min)(left, step_);
+            return *this;
+        }
+
+        iterator operator++(int) noexcept
+        {
+            auto rc = *this;
+            ++(*this);
+            return rc;
+        }
+
+        bool operator==(const iterator& other) const noexcept
+        {
+            return ptr_ == other.ptr_;
+        }
+
+        bool operator!=(const iterator& other) const noexcept
+        {
+            return ptr_ != other.ptr_;
+        }
+    };
+
+    segments() = default;
+
+    // segment_size == 0 - буфер содержит одну датаграмму
+    segments(const char* data, std::size_t size,
+        std::size_t segment_size) noexcept
+        : data_(data)
+        , size_(size)
+        , segment_size_((segment_size) ? segment_size : size)
+    {   }
+
+    iterator begin() const noexcept
+    {
+        return iterator(data_, data_ + size_, segment_size_);
+    }
+
+    iterator end() const noexcept
+    {
+        auto e = data_ + size_;
+        return iterator(e, e, segment_size_);
+    }
+
+    std::size_t size() const noexcept
+    {
+        return (segment_size_) ?
+            (size_ + segment_size_ - 1) / segment_size_ : 0;
+    }
+
+    bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+};
+
+// принятая датаграмма
+// ссылается на слот кольца приема
+// валидна до следующего recv
+class datagram
+{
+    const char* data_{nullptr};
+    std::size_t size_{};
+    const sockaddr* sa_{nullptr};
+    ev_socklen_t salen_{};
+    timespec stamp_{};
+    std::size_t segment_size_{};
+    packet_stamp stamps_{};
+
+    friend class recv_ring;
+
+public:
+    datagram() = default;
+
+    const char* data() const noexcept
+    {
+        return data_;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+
+    std::string_view view() const noexcept
+    {
+        return std::string_view(data_, size_);
+    }
+
+    const sockaddr* sa() const noexcept
+    {
+        return sa_;
+    }
+
+    ev_socklen_t salen() const noexcept
+    {
+        return salen_;
+    }
+
+    sock_addr peer() const
+    {
+        return (salen_) ? sock_addr(sa_, salen_) : sock_addr();
+    }
+
+    // SO_TIMESTAMPNS
+    // нулевое значение если опция не включена
+    const timespec& stamp() const noexcept
+    {
+        return stamp_;
+    }
+
+    // SO_TIMESTAMPING
+    // программная и аппаратная отметки приема
+    const packet_stamp& stamps() const noexcept
+    {
+        return stamps_;
+    }
+
+    // UDP_GRO размер сегмента склеенного буфера
+    // 0 если ядро вернуло одну датаграмму
+    std::size_t segment_size() const noexcept
+    {
+        return segment_size_;
+    }
+
+    segments split() const noexcept
+    {
+        return segments(data_, size_, segment_size_);
+    }
+};
+
+// кольцо заранее выделенных слотов для recvmmsg
+// один системный вызов заполняет до slots() датаграмм
+class recv_ring
+{
+public:
+    using value_type = datagram;
+    using const_iterator = std::vector<datagram>::const_iterator;
+
+    constexpr static std::size_t control_size =
+        CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(int))
+#ifdef SO_TIMESTAMPING
+        + timestamping::control_size
+#endif // SO_TIMESTAMPING
+        ;
+
+private:
+    std::size_t slot_size_{};
+    std::vector<char> data_{};
+    std::vector<char> control_{};
+    std::vector<sockaddr_storage> addr_{};
+    std::vector<iovec> iov_{};
+    std::vector<mmsghdr> hdr_{};
+    std::vector<datagram> ready_{};
+    std::size_t count_{};
+
+    char* slot_data(std::size_t i) noexcept
+    {
+        return data_.data() + i * slot_size_;
+    }
+
+    char* slot_control(std::size_t i) noexcept
+    {
+        return control_.data() + i * control_size;
+    }
+
+    // ядро меняет длины при каждом вызове
+    void rewind() noexcept
+    {
+        for (std::size_t i = 0; i < hdr_.size(); ++i)
+        {
+            auto& msg = hdr_[i].msg_hdr;
+            msg.msg_namelen = sizeof(sockaddr_storage);
+            msg.msg_controllen = control_size;
+            msg.msg_flags = 0;
+            hdr_[i].msg_len = 0;
+        }
+    }
+
+    static inline void parse_control(msghdr& msg, datagram& dgram) noexcept
+    {
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+             cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+#ifdef SCM_TIMESTAMPNS
+            if ((cmsg->cmsg_level == SOL_SOCKET) &&
+                (cmsg->cmsg_type == SCM_TIMESTAMPNS))
+            {
+                std::memcpy(&dgram.stamp_, CMSG_DATA(cmsg), sizeof(timespec));
+            }
+#endif // SCM_TIMESTAMPNS
+#ifdef SO_TIMESTAMPING
+            timestamping::parse(cmsg, dgram.stamps_);
+#endif // SO_TIMESTAMPING
+#ifdef UDP_GRO
+            if ((cmsg->cmsg_level == IPPROTO_UDP) &&
+                (cmsg->cmsg_type == UDP_GRO))
+            {
+                int segment_size = 0;
+                std::memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(int));
+                dgram.segment_size_ = static_cast<std::size_t>(segment_size);
+            }
+#endif // UDP_GRO
+        }
+    }
+
+public:
+    recv_ring(std::size_t slots, std::size_t slot_size)
+        : slot_size_(slot_size)
+        , data_(slots * slot_size)
+        , control_(slots * control_size)
+        , addr_(slots)
+        , iov_(slots)
+        , hdr_(slots)
+        , ready_(slots)
+    {
+        assert(slots && slot_size);
+
+        for (std::size_t i = 0; i < slots; ++i)
+        {
+            iov_[i].iov_base = slot_data(i);
+            iov_[i].iov_len = slot_size_;
+
+            auto& msg = hdr_[i].msg_hdr;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_name = &addr_[i];
+            msg.msg_iov = &iov_[i];
+            msg.msg_iovlen = 1;
+            msg.msg_control = slot_control(i);
+        }
+
+        rewind();
+    }
+
+    recv_ring(const recv_ring&) = delete;
+    recv_ring& operator=(const recv_ring&) = delete;
+
+    // принять пачку датаграмм
+    // возвращает число принятых или code::fail (см. socket::wouldblock)
+    int recv(socket sock, int flags = MSG_DONTWAIT) noexcept
+    {
+        count_ = 0;
+        rewind();
+
+        auto res = sock.recvmmsg(hdr_.data(),
+            static_cast<unsigned int>(hdr_.size()), flags);
+        if (res == code::fail)
+            return res;
+
+        for (int i = 0; i < res; ++i)
+        {
+            auto& msg = hdr_[i].msg_hdr;
+            auto& dgram = ready_[i];
+            dgram.data_ = slot_data(i);
+            dgram.size_ = hdr_[i].msg_len;
+            dgram.sa_ = reinterpret_cast<const sockaddr*>(&addr_[i]);
+            dgram.salen_ = static_cast<ev_socklen_t>(msg.msg_namelen);
+            dgram.stamp_ = timespec{};
+            dgram.segment_size_ = 0;
+            dgram.stamps_ = packet_stamp();
+            parse_control(msg, dgram);
+        }
+
+        count_ = static_cast<std::size_t>(res);
+
+        return res;
+    }
+
+    // датаграмма была обрезана до slot_size
+    bool truncated(std::size_t i) const noexcept
+    {
+        assert(i < count_);
+        return (hdr_[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+    }
+
+    const datagram& operator[](std::size_t i) const noexcept
+    {
+        assert(i < count_);
+        return ready_[i];
+    }
+
+    const_iterator begin() const noexcept
+    {
+        return ready_.begin();
+    }
+
+    const_iterator end() const noexcept
+    {
+        return ready_.begin() + static_cast<std::ptrdiff_t>(count_);
+    }
+
+    std::size_t size() const noexcept
+    {
+        return count_;
+    }
+
+    bool empty() const noexcept
+    {
+        return count_ == 0;
+    }
+
+    std::size_t slots() const noexcept
+    {
+        return hdr_.size();
+    }
+
+    std::size_t slot_size() const noexcept
+    {
+        return slot_size_;
+    }
+};
+
+// пакетная отправка через sendmmsg
+// данные не копируются и должны жить до flush
+class send_batch
+{
+public:
+    constexpr static std::size_t control_size =
+        CMSG_SPACE(sizeof(std::uint16_t));
+
+private:
+    std::vector<char> control_{};
+    std::vector<sockaddr_storage> addr_{};
+    std::vector<iovec> iov_{};
+    std::vector<mmsghdr> hdr_{};
+    std::size_t sent_{};
+    std::size_t count_{};
+    // отброшенные из-за ошибки сообщения
+    std::uint64_t errors_{};
+    int last_error_{};
+
+    mmsghdr& next(const void *data, std::size_t len)
+    {
+        assert(data && len);
+        if (full())
+            throw std::runtime_error("send_batch full");
+
+        auto i = count_++;
+        iov_[i].iov_base = const_cast<void*>(data);
+        iov_[i].iov_len = len;
+
+        auto& hdr = hdr_[i];
+        std::memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_hdr.msg_iov = &iov_[i];
+        hdr.msg_hdr.msg_iovlen = 1;
+        return hdr;
+    }
+
+public:
+    explicit send_batch(std::size_t capacity)
+        : control_(capacity * control_size)
+        , addr_(capacity)
+        , iov_(capacity)
+        , hdr_(capacity)
+    {
+        assert(capacity);
+    }
+
+    send_batch(const send_batch&) = delete;
+    send_batch& operator=(const send_batch&) = delete;
+
+    // для подключенного сокета
+    void push(const void *data, std::size_t len)
+    {
+        next(data, len);
+    }
+
+    void push(const ip::addr& addr, const void *data, std::size_t len)
+    {
+        assert(addr.size() <= sizeof(sockaddr_storage));
+
+        auto& hdr = next(data, len);
+        auto i = count_ - 1;
+        std::memcpy(&addr_[i], addr.sa(), addr.size());
+        hdr.msg_hdr.msg_name = &addr_[i];
+        hdr.msg_hdr.msg_namelen = addr.size();
+    }
+
+    void push(const ip::addr& addr, std::string_view data)
+    {
+        push(addr, data.data(), data.size());
+    }
+
+#ifdef UDP_SEGMENT
+    // UDP_SEGMENT (GSO)
+    // ядро нарежет буфер на датаграммы по segment_size байт
+    // len не больше 64KB и не больше 64 сегментов
+    void push(const ip::addr& addr, const void *data,
+        std::size_t len, std::uint16_t segment_size)
+    {
+        assert(segment_size);
+
+        push(addr, data, len);
+
+        auto i = count_ - 1;
+        auto& msg = hdr_[i].msg_hdr;
+        msg.msg_control = control_.data() + i * control_size;
+        msg.msg_controllen = control_size;
+
+        auto cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = IPPROTO_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(segment_size));
+        std::memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+    }
+#endif // UDP_SEGMENT
+
+    // отправить все что накопили
+    // при частичной отправке остаток сохраняется до следующего flush
+    // сообщение с постоянной ошибкой (EMSGSIZE, ECONNREFUSED, EHOSTUNREACH)
+    // отбрасывается, иначе оно задержит всю пачку, см. errors и last_error
+    // возвращает число отправленных или code::fail (см. socket::wouldblock)
+    int flush(socket sock, int flags = MSG_DONTWAIT) noexcept
+    {
+        int total = 0;
+        while (sent_ < count_)
+        {
+            auto res = sock.sendmmsg(hdr_.data() + sent_,
+                static_cast<unsigned int>(count_ - sent_), flags);
+            if (res == code::fail)
+            {
+                auto err = net::error();
+                if ((err == net::ewouldblock) || (err == net::eagain))
+                    return (total) ? total : res;
+                if (err == EINTR)
+                    continue;
+
+                // ошибка относится к первому неотправленному сообщению
+                ++sent_;
+                ++errors_;
+                last_error_ = err;
+                continue;
+            }
+
+            sent_ += static_cast<std::size_t>(res);
+            total += res;
+        }
+
+        clear();
+
+        return total;
+    }
+
+    void clear() noexcept
+    {
+        sent_ = 0;
+        count_ = 0;
+    }
+
+    // ожидают отправки
+    std::size_t size() const noexcept
+    {
+        return count_ - sent_;
+    }
+
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    bool full() const noexcept
+    {
+        return count_ == hdr_.size();
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return hdr_.size();
+    }
+
+    // всего отброшено сообщений
+    std::uint64_t errors() const noexcept
+    {
+        return errors_;
+    }
+
+    // код ошибки последнего отброшенного сообщения
+    int last_error() const noexcept
+    {
+        return last_error_;
+    }
+};
+
+} // namespace udp
+} // namespace btpro
+
+#endif // __linux__
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "btpro/udp/mmsg.hpp"
+#include "btpro/ev.hpp"
+
+#ifdef __linux__
+
+#include <functional>
+
+namespace btpro {
+namespace udp {
+
+// читает датаграммы пачками по событию EV_READ
+// за одно событие выполняет не больше budget вызовов recvmmsg
+// чтобы один горячий сокет не занимал всю очередь
+class reader
+{
+public:
+    typedef std::function<void(const recv_ring&)> handler_t;
+    typedef std::function<void(std::exception_ptr)> throw_t;
+#ifdef SO_TIMESTAMPING
+    typedef std::function<void(const tx_stamp&)> tx_handler_t;
+#endif // SO_TIMESTAMPING
+
+private:
+    recv_ring ring_;
+    handler_t handler_{};
+    throw_t on_throw_{};
+#ifdef SO_TIMESTAMPING
+    tx_handler_t tx_handler_{};
+#endif // SO_TIMESTAMPING
+    std::size_t budget_{16};
+    ev_stack event_{};
+
+    template<class T>
+    struct proxy
+    {
+        static void evcb(evutil_socket_t fd, event_flag, void *obj) noexcept
+        {
+            assert(obj);
+            static_cast<T*>(obj)->dispatch(socket(fd));
+        }
+    };
+
+#ifdef SO_TIMESTAMPING
+    // очередь ошибок держит сокет готовым к чтению
+    // ее надо вычитать иначе EV_READ будет срабатывать постоянно
+    void dispatch_errqueue(socket sock)
+    {
+        tx_stamp stamp;
+        for (std::size_t i = 0; i < budget_ * ring_.slots(); ++i)
+        {
+            auto res = sock.recv_tx_stamp(stamp);
+            if (res == code::fail)
+            {
+                if (!socket::wouldblock())
+                    throw std::system_error(net::error_code(), "MSG_ERRQUEUE");
+                break;
+            }
+
+            if (res)
+                tx_handler_(stamp);
+        }
+    }
+#endif // SO_TIMESTAMPING
+
+    void dispatch(socket sock) noexcept
+    {
+        try
+        {
+#ifdef SO_TIMESTAMPING
+            if (tx_handler_)
+                dispatch_errqueue(sock);
+#endif // SO_TIMESTAMPING
+
+            for (std::size_t i = 0; i < budget_; ++i)
+            {
+                auto res = ring_.recv(sock);
+                if (res == code::fail)
+                {
+                    if (!socket::wouldblock())
+                        throw std::system_error(net::error_code(), "::recvmmsg");
+                    break;
+                }
+
+                handler_(ring_);
+
+                // сокет пуст
+                if (ring_.size() < ring_.slots())
+                    break;
+            }
+        }
+        catch (...)
+        {
+            on_throw(std::current_exception());
+        }
+    }
+
+    void on_throw(std::exception_ptr ep) noexcept
+    {
+        try
+        {
+            if (on_throw_)
+                on_throw_(ep);
+        }
+        catch (...)
+        {   }
+    }
+
+public:
+    reader(queue_pointer queue, socket sock, std::size_t slots,
+        std::size_t slot_size, handler_t handler)
+        : ring_(slots, slot_size)
+        , handler_(std::move(handler))
+    {
+        assert(queue && sock.good() && handler_);
+        event_.create(queue, sock.fd(), EV_READ|EV_PERSIST,
+            proxy<reader>::evcb, this);
+    }
+
+    reader(const reader&) = delete;
+    reader& operator=(const reader&) = delete;
+
+    reader& set(handler_t handler)
+    {
+        assert(handler);
+        handler_ = std::move(handler);
+        return *this;
+    }
+
+    reader& set(throw_t handler)
+    {
+        on_throw_ = std::move(handler);
+        return *this;
+    }
+
+#ifdef SO_TIMESTAMPING
+    // отметки отправки (timestamping::tx_software, tx_hardware)
+    // обязателен если на сокете включены tx отметки
+    reader& set(tx_handler_t handler)
+    {
+        tx_handler_ = std::move(handler);
+        return *this;
+    }
+#endif // SO_TIMESTAMPING
+
+    // максимальное число recvmmsg за одно событие
+    reader& set_budget(std::size_t budget) noexcept
+    {
+        assert(budget);
+        budget_ = budget;
+        return *this;
+    }
+
+    void enable()
+    {
+        event_.add();
+    }
+
+    void disable()
+    {
+        event_.remove();
+    }
+
+    const recv_ring& ring() const noexcept
+    {
+        return ring_;
+    }
+};
+
+} // namespace udp
+} // namespace btpro
+
+#endif // __linux__
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "btpro/btpro.hpp"
+
+namespace btpro {
+namespace udp {
+
+} // namespace udp
+} // namespace btpro
+
+namespace bu = btpro::udp;
@@ -1,63 +1,324 @@
 #pragma once
 
 #include "btpro/config.hpp"
+#include "btpro/ip/text.hpp"
+
+#include <string>
 #include <string_view>
-#include "event2/http.h"
+#include <iterator>
 
 namespace btpro {
 
-using uri_handle_type = evhttp_uri*;
-
-class uri final
+// разбор uri без аллокаций, компоненты - string_view в исходную строку
+// правила те же, что у evhttp_uri_parse без EVHTTP_URI_NONCONFORMANT
+// отсутствующий компонент - пустой view с data() == nullptr
+// host ipv6 возвращается в скобках, как у evhttp_uri_get_host
+class uri_view
 {
-public:
-    using handle_type = uri_handle_type;
+    using sv = std::string_view;
+    constexpr static auto npos = sv::npos;
 
-private:
-    struct deallocate
+    sv scheme_{};
+    sv userinfo_{};
+    sv host_{};
+    sv path_{};
+    sv query_{};
+    sv fragment_{};
+    int port_{-1};
+
+    static bool is_alpha(char c) noexcept
+    {
+        return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z'));
+    }
+
+    static bool is_digit(char c) noexcept
+    {
+        return (c >= '0') && (c <= '9');
+    }
+
+    static bool is_xdigit(char c) noexcept
+    {
+        return is_digit(c) || ((c >= 'a') && (c <= 'f')) ||
+            ((c >= 'A') && (c <= 'F'));
+    }
+
+    static bool is_unreserved(char c) noexcept
+    {
+        return is_alpha(c) || is_digit(c) ||
+            (c == '-') || (c == '.') || (c == '_') || (c == '~');
+    }
+
+    static bool is_subdelim(char c) noexcept
     {
-        void operator()(handle_type ptr) noexcept 
-        { 
-            evhttp_uri_free(ptr); 
+        switch (c)
+        {
+        case '!': case '$': case '&': case '\'': case '(': case ')':
+        case '*': case '+': case ',': case ';': case '=':
+            return true;
         }
-    };
-    using ptr_type = std::unique_ptr<evhttp_uri, deallocate>;
-    ptr_type handle_{};
+        return false;
+    }
 
-    using sv = std::string_view;
-    constexpr static auto npos = sv::npos;
+    static bool is_pct(sv s, std::size_t i) noexcept
+    {
+        return (s[i] == '%') && (i + 2 < s.size()) &&
+            is_xdigit(s[i + 1]) && is_xdigit(s[i + 2]);
+    }
 
-public:
-    uri() = default;
-    uri(uri&&) = default;
-    uri& operator=(uri&&) = default;
+    static bool scheme_ok(sv s) noexcept
+    {
+        if (s.empty() || !is_alpha(s[0]))
+            return false;
 
-    explicit uri(const char *source_uri)
-        : handle_{detail::check_pointer("evhttp_uri_parse",
-            evhttp_uri_parse(source_uri))}
+        for (std::size_t i = 1; i < s.size(); ++i)
+        {
+            auto c = s[i];
+            if (!is_alpha(c) && !is_digit(c) && (c != '+') && (c != '-') && (c != '.'))
+                return false;
+        }
+        return true;
+    }
+
+    static bool userinfo_ok(sv s) noexcept
     {
-        assert(source_uri);
+        for (std::size_t i = 0; i < s.size();)
+        {
+            auto c = s[i];
+            if (is_unreserved(c) || is_subdelim(c) || (c == ':'))
+                ++i;
+            else if (is_pct(s, i))
+                i += 3;
+            else
+                return false;
+        }
+        return true;
     }
 
-    explicit uri(const std::string& source_uri)
-        : uri{source_uri.c_str()}
-    {   }
+    static bool regname_ok(sv s) noexcept
+    {
+        for (std::size_t i = 0; i < s.size();)
+        {
+            auto c = s[i];
+            if (is_unreserved(c) || is_subdelim(c))
+                ++i;
+            else if (is_pct(s, i))
+                i += 3;
+            else
+                return false;
+        }
+        return true;
+    }
+
+    // "[v1.x]" или "[ipv6]"
+    static bool bracket_ok(sv s) noexcept
+    {
+        if ((s.size() < 3) || (s.front() != '[') || (s.back() != ']'))
+            return false;
+
+        s = s.substr(1, s.size() - 2);
+        if (s[0] == 'v')
+        {
+            std::size_t i = 1;
+            if ((i == s.size()) || !is_xdigit(s[i]))
+                return false;
+            while ((i < s.size()) && (s[i] != '.'))
+            {
+                if (!is_xdigit(s[i++]))
+                    return false;
+            }
+            if (i == s.size())
+                return false;
+            for (++i; i < s.size(); ++i)
+            {
+                auto c = s[i];
+                if (!is_unreserved(c) && !is_subdelim(c) && (c != ':'))
+                    return false;
+            }
+            return true;
+        }
+
+        in6_addr in6;
+        auto last = s.data() + s.size();
+        auto res = ip::from_chars(s.data(), last, in6);
+        return (res.ec == std::errc()) && (res.ptr == last);
+    }
 
-    handle_type handle() const noexcept
+    static int parse_port(sv s) noexcept
     {
-        return handle_.get();
+        int rc = 0;
+        for (auto c : s)
+        {
+            if (!is_digit(c))
+                return -1;
+            rc = rc * 10 + (c - '0');
+            if (rc > 65535)
+                return -1;
+        }
+        return rc;
+    }
+
+    bool parse_authority(sv s) noexcept
+    {
+        if (s.empty())
+        {
+            host_ = s;
+            return true;
+        }
+
+        auto at = s.find('@');
+        if (at != npos)
+        {
+            userinfo_ = s.substr(0, at);
+            if (!userinfo_ok(userinfo_))
+                return false;
+            s.remove_prefix(at + 1);
+        }
+
+        // ":port" в конце, пустой порт допустим
+        auto p = s.size();
+        while (p && is_digit(s[p - 1]))
+            --p;
+        if (p && (s[p - 1] == ':'))
+        {
+            if (p < s.size())
+            {
+                port_ = parse_port(s.substr(p));
+                if (port_ < 0)
+                    return false;
+            }
+            s = s.substr(0, p - 1);
+        }
+
+        if ((s.size() >= 2) && (s.front() == '[') && (s.back() == ']'))
+        {
+            if (!bracket_ok(s))
+                return false;
+        }
+        else if (!regname_ok(s))
+            return false;
+
+        host_ = s;
+        return true;
+    }
+
+    // query и fragment допускают '?'
+    static std::size_t end_of_path(sv s, std::size_t i, bool path) noexcept
+    {
+        while (i < s.size())
+        {
+            auto c = s[i];
+            if (is_unreserved(c) || is_subdelim(c) ||
+                (c == ':') || (c == '@') || (c == '/'))
+            {
+                ++i;
+            }
+            else if (is_pct(s, i))
+                i += 3;
+            else if ((c == '?') && !path)
+                ++i;
+            else
+                break;
+        }
+        return i;
+    }
+
+    static bool path_matches_noscheme(sv path) noexcept
+    {
+        for (auto c : path)
+        {
+            if (c == ':')
+                return false;
+            if (c == '/')
+                return true;
+        }
+        return true;
+    }
+
+    static int hex_value(char c) noexcept
+    {
+        return (is_digit(c)) ? c - '0' : ((c | 0x20) - 'a' + 10);
+    }
+
+public:
+    uri_view() = default;
+
+    // исключение если uri неверный
+    explicit uri_view(std::string_view text)
+    {
+        if (!parse(text))
+            throw std::runtime_error("uri parse");
+    }
+
+    // false - uri неверный, компоненты не определены
+    bool parse(std::string_view text) noexcept
+    {
+        *this = uri_view();
+
+        // evhttp читает строку до нуля
+        auto z = text.find('\0');
+        if (z != npos)
+            return false;
+
+        std::size_t pos = 0;
+        auto colon = text.find(':');
+        if ((colon != npos) && scheme_ok(text.substr(0, colon)))
+        {
+            scheme_ = text.substr(0, colon);
+            pos = colon + 1;
+        }
+
+        bool authority = false;
+        if (text.substr(pos, 2) == "//")
+        {
+            pos += 2;
+            auto end = text.find_first_of("/?#", pos);
+            if (end == npos)
+                end = text.size();
+            if (!parse_authority(text.substr(pos, end - pos)))
+                return false;
+            pos = end;
+            authority = true;
+        }
+
+        auto end = end_of_path(text, pos, true);
+        path_ = text.substr(pos, end - pos);
+        pos = end;
+
+        if ((pos < text.size()) && (text[pos] == '?'))
+        {
+            end = end_of_path(text, ++pos, false);
+            query_ = text.substr(pos, end - pos);
+            pos = end;
+        }
+
+        if ((pos < text.size()) && (text[pos] == '#'))
+        {
+            end = end_of_path(text, ++pos, false);
+            fragment_ = text.substr(pos, end - pos);
+            pos = end;
+        }
+
+        if (pos != text.size())
+            return false;
+
+        if (!authority && (path_.substr(0, 2) == "//"))
+            return false;
+        if (authority && !path_.empty() && (path_[0] != '/'))
+            return false;
+        if (scheme_.data() == nullptr && !path_matches_noscheme(path_))
+            return false;
+
+        return true;
     }
 
     std::string_view scheme() const noexcept
     {
-        auto rc = evhttp_uri_get_scheme(assert_handle(handle()));
-        return (rc) ? sv{rc} : sv{};
+        return scheme_;
     }
 
     std::string_view userinfo() const noexcept
     {
-        auto rc = evhttp_uri_get_userinfo(assert_handle(handle()));
-        return (rc) ? sv{rc} : sv{};
+        return userinfo_;
     }
 
     static inline auto split_userinfo(std::string_view userinfo) noexcept
@@ -75,25 +336,23 @@ public:
 
     std::string_view host() const noexcept
     {
-        auto rc = evhttp_uri_get_host(assert_handle(handle()));
-        return (rc) ? sv{rc} : sv{};
+        return host_;
     }
 
+    // -1 - порт не указан
     int port() const noexcept
     {
-        return evhttp_uri_get_port(assert_handle(handle()));
+        return port_;
     }
 
     int port(int def) const noexcept
     {
-        auto rc = port();
-        return (rc < 1) ? def : rc;
+        return (port_ < 1) ? def : port_;
     }
 
     std::string_view path() const noexcept
     {
-        auto rc = evhttp_uri_get_path(assert_handle(handle()));
-        return (rc) ? sv{rc} : sv{};
+        return path_;
     }
 
     std::string_view rpath() const noexcept
@@ -104,46 +363,354 @@ public:
 
     std::string_view query() const noexcept
     {
-        auto rc = evhttp_uri_get_query(assert_handle(handle()));
-        return (rc) ? sv{rc} : sv{};
+        return query_;
     }
 
     std::string_view fragment() const noexcept
     {
-        auto rc = evhttp_uri_get_fragment(handle());
-        return (rc) ? sv{rc} : sv{};
+        return fragment_;
     }
 
-    std::string addr() const
+    // "host:port" или "host" без порта, как addr() у uri
+    std::to_chars_result addr(char *first, char *last) const noexcept
     {
-        std::string rc;
-        auto h = host();
-        auto p = port();
-        if (!h.empty())
+        return addr_port(first, last, port_);
+    }
+
+    // def - порт если в uri его нет
+    std::to_chars_result addr_port(char *first, char *last, int def) const noexcept
+    {
+        auto p = port(def);
+        auto need = host_.size();
+        if (host_.empty())
+            return { first, std::errc() };
+        if (static_cast<std::size_t>(last - first) < need)
+            return { last, std::errc::value_too_large };
+
+        std::memcpy(first, host_.data(), need);
+        first += need;
+        if (p <= 0)
+            return { first, std::errc() };
+
+        if (first == last)
+            return { last, std::errc::value_too_large };
+        *first++ = ':';
+        return ip::port_to_chars(first, last, p);
+    }
+
+    // %XX в out, результат не длиннее in, out может совпадать с in.data()
+    // неверные последовательности % копируются как есть
+    // plus_space - '+' как пробел, для application/x-www-form-urlencoded
+    static std::size_t decode(std::string_view in, char *out,
+        bool plus_space = false) noexcept
+    {
+        assert(out || in.empty());
+
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < in.size(); ++i)
         {
-            rc += h;
-            if (p > 0)
+            auto c = in[i];
+            if (is_pct(in, i))
             {
-                rc += ':';
-                rc += std::to_string(p);
+                out[n++] = static_cast<char>(
+                    (hex_value(in[i + 1]) << 4) | hex_value(in[i + 2]));
+                i += 2;
             }
+            else if (plus_space && (c == '+'))
+                out[n++] = ' ';
+            else
+                out[n++] = c;
         }
-        return rc;
+        return n;
+    }
+
+    // параметры "a=1&b&c=3" без декодирования, пустые пропускаются
+    // у параметра без '=' значение пустое
+    class params
+    {
+        sv query_{};
+
+    public:
+        class iterator
+        {
+            sv rest_{};
+            std::pair<sv, sv> value_{};
+            bool end_{true};
+
+            void next() noexcept
+            {
+                while (!rest_.empty())
+                {
+                    auto f = rest_.find('&');
+                    auto item = rest_.substr(0, f);
+                    rest_ = (f == npos) ? sv{} : rest_.substr(f + 1);
+                    if (item.empty())
+                        continue;
+
+                    auto eq = item.find('=');
+                    value_ = (eq == npos) ?
+                        std::make_pair(item, item.substr(item.size())) :
+                        std::make_pair(item.substr(0, eq), item.substr(eq + 1));
+                    end_ = false;
+                    return;
+                }
+                end_ = true;
+            }
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::pair<sv, sv>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type*;
+            using reference = const value_type&;
+
+            iterator() = default;
+
+            explicit iterator(sv query) noexcept
+                : rest_(query)
+            {
+                next();
+            }
+
+            reference operator*() const noexcept
+            {
+                return value_;
+            }
+
+            pointer operator->() const noexcept
+            {
+                return &value_;
+            }
+
+            iterator& operator++() noexcept
+            {
+                next();
+                return *this;
+            }
+
+            iterator operator++(int) noexcept
+            {
+                auto rc = *this;
+                next();
+                return rc;
+            }
+
+            bool operator==(const iterator& other) const noexcept
+            {
+                if (end_ || other.end_)
+                    return end_ == other.end_;
+                return (rest_.data() == other.rest_.data()) &&
+                    (value_.first.data() == other.value_.first.data());
+            }
+
+            bool operator!=(const iterator& other) const noexcept
+            {
+                return !(*this == other);
+            }
+        };
+
+        params() = default;
+
+        explicit params(sv query) noexcept
+            : query_(query)
+        {   }
+
+        iterator begin() const noexcept
+        {
+            return iterator(query_);
+        }
+
+        iterator end() const noexcept
+        {
+            return iterator();
+        }
+
+        // значение первого параметра key, data() == nullptr если нет
+        sv find(sv key) const noexcept
+        {
+            for (auto& kv : *this)
+            {
+                if (kv.first == key)
+                    return kv.second;
+            }
+            return sv{};
+        }
+    };
+
+    params query_params() const noexcept
+    {
+        return params(query_);
+    }
+};
+
+// uri с копией исходной строки, компоненты смотрят в нее
+// одна аллокация вместо строки на каждый компонент у evhttp_uri
+class uri final
+{
+    std::string text_{};
+    uri_view view_{};
+
+    using sv = std::string_view;
+
+    void reparse() noexcept
+    {
+        auto rc = view_.parse(text_);
+        assert(rc);
+        (void)rc;
+    }
+
+public:
+    uri() = default;
+
+    uri(const uri& other)
+        : text_(other.text_)
+    {
+        reparse();
+    }
+
+    uri(uri&& other) noexcept
+        : text_(std::move(other.text_))
+    {
+        reparse();
+        other.text_.clear();
+        other.view_ = uri_view();
+    }
+
+    uri& operator=(const uri& other)
+    {
+        if (this != &other)
+        {
+            text_ = other.text_;
+            reparse();
+        }
+        return *this;
+    }
+
+    uri& operator=(uri&& other) noexcept
+    {
+        if (this != &other)
+        {
+            text_ = std::move(other.text_);
+            reparse();
+            other.text_.clear();
+            other.view_ = uri_view();
+        }
+        return *this;
+    }
+
+    explicit uri(std::string source_uri)
+        : text_(std::move(source_uri))
+    {
+        if (!view_.parse(text_))
+            throw std::runtime_error("uri parse");
+    }
+
+    explicit uri(const char *source_uri)
+        : uri{std::string(source_uri)}
+    {
+        assert(source_uri);
+    }
+
+    const uri_view& view() const noexcept
+    {
+        return view_;
+    }
+
+    const std::string& str() const noexcept
+    {
+        return text_;
+    }
+
+    std::string_view scheme() const noexcept
+    {
+        return view_.scheme();
+    }
+
+    std::string_view userinfo() const noexcept
+    {
+        return view_.userinfo();
+    }
+
+    static inline auto split_userinfo(std::string_view userinfo) noexcept
+    {
+        return uri_view::split_userinfo(userinfo);
+    }
+
+    auto auth() const noexcept
+    {
+        return view_.auth();
+    }
+
+    std::string_view host() const noexcept
+    {
+        return view_.host();
+    }
+
+    int port() const noexcept
+    {
+        return view_.port();
+    }
+
+    int port(int def) const noexcept
+    {
+        return view_.port(def);
+    }
+
+    std::string_view path() const noexcept
+    {
+        return view_.path();
+    }
+
+    std::string_view rpath() const noexcept
+    {
+        return view_.rpath();
+    }
+
+    std::string_view query() const noexcept
+    {
+        return view_.query();
+    }
+
+    std::string_view fragment() const noexcept
+    {
+        return view_.fragment();
+    }
+
+    uri_view::params query_params() const noexcept
+    {
+        return view_.query_params();
+    }
+
+    std::string addr() const
+    {
+        return addr_string(host(), port());
     }
 
     std::string addr_port(int def) const
     {
-        std::string rc;
         auto h = host();
         auto p = port(def);
-        if (!(h.empty() || (p <= 0)))
+        if (h.empty() || (p <= 0))
+            return std::string();
+        return addr_string(h, p);
+    }
+
+private:
+    static std::string addr_string(sv h, int p)
+    {
+        std::string rc;
+        if (!h.empty())
         {
+            rc.reserve(h.size() + 6);
             rc += h;
-            rc += ':';
-            rc += std::to_string(p);
+            if (p > 0)
+            {
+                rc += ':';
+                rc += std::to_string(p);
+            }
         }
         return rc;
     }
 };
 
-} // namespace btpro
\ No newline at end of file
+} // namespace btpro
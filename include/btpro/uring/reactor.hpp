@@ -0,0 +1,405 @@
+#pragma once
+
+#include "btpro/uring/ring.hpp"
+#include "btpro/config.hpp"
+#include "btpro/socket.hpp"
+#include "btpro/ev.hpp"
+
+#ifdef BTPRO_URING
+
+#include <sys/eventfd.h>
+#include <functional>
+
+namespace btpro {
+namespace uring {
+
+// операции io_uring поверх очереди libevent
+// завершения приходят через eventfd, который слушает queue
+// все sqe подготовленные за один проход цикла уходят одним io_uring_enter
+class reactor
+{
+public:
+    // res - результат операции или -errno, flags - IORING_CQE_F_*
+    typedef std::function<void(int res, unsigned flags)> handler_t;
+    // данные лежат в буфере кольца только на время вызова
+    typedef std::function<void(int res, const char *data)> recv_t;
+    typedef std::function<void(std::exception_ptr)> throw_t;
+    // идентификатор операции для cancel
+    typedef std::uint64_t token_t;
+
+private:
+    struct op
+    {
+        handler_t handler{};
+        msghdr msg{};
+        // перезапущена из обработчика, не удалять
+        bool rearm{false};
+        op *prev{nullptr};
+        op *next{nullptr};
+    };
+
+    // операции живут до последнего cqe
+    // объявлен до ring_ и удаляется после закрытия кольца
+    struct op_list
+    {
+        op *head{nullptr};
+
+        ~op_list() noexcept
+        {
+            while (head)
+            {
+                auto next = head->next;
+                delete head;
+                head = next;
+            }
+        }
+
+        void push(op *p) noexcept
+        {
+            p->next = head;
+            if (head)
+                head->prev = p;
+            head = p;
+        }
+
+        void erase(op *p) noexcept
+        {
+            if (p->prev)
+                p->prev->next = p->next;
+            else
+                head = p->next;
+            if (p->next)
+                p->next->prev = p->prev;
+            delete p;
+        }
+    };
+
+    struct fd_holder
+    {
+        int fd{-1};
+
+        ~fd_holder() noexcept
+        {
+            if (fd != -1)
+                ::close(fd);
+        }
+    };
+
+    op_list ops_{};
+    ring ring_;
+    fd_holder efd_{};
+    ev_stack complete_{};
+    ev_stack flush_{};
+    bool flush_pending_{false};
+    throw_t on_throw_{};
+
+    template<class T>
+    struct proxy
+    {
+        static void complete(evutil_socket_t, event_flag, void *obj) noexcept
+        {
+            assert(obj);
+            static_cast<T*>(obj)->dispatch();
+        }
+
+        static void flush(evutil_socket_t, event_flag, void *obj) noexcept
+        {
+            assert(obj);
+            static_cast<T*>(obj)->do_flush();
+        }
+    };
+
+    void on_throw(std::exception_ptr ep) noexcept
+    {
+        try
+        {
+            if (on_throw_)
+                on_throw_(ep);
+        }
+        catch (...)
+        {   }
+    }
+
+    void do_flush() noexcept
+    {
+        flush_pending_ = false;
+        try
+        {
+            if (ring_.pending())
+                ring_.submit();
+        }
+        catch (...)
+        {
+            on_throw(std::current_exception());
+        }
+    }
+
+    void dispatch() noexcept
+    {
+        std::uint64_t value;
+        while (::read(efd_.fd, &value, sizeof(value)) > 0)
+            ;
+
+        ring_.reap([&](const io_uring_cqe& cqe) {
+            // служебные операции (cancel) без обработчика
+            if (!cqe.user_data)
+                return;
+
+            auto p = reinterpret_cast<op*>(cqe.user_data);
+            p->rearm = false;
+            try
+            {
+                p->handler(cqe.res, cqe.flags);
+            }
+            catch (...)
+            {
+                on_throw(std::current_exception());
+            }
+
+            if (!(cqe.flags & IORING_CQE_F_MORE) && !p->rearm)
+                ops_.erase(p);
+        });
+    }
+
+    // нет места в кольце - отправляем накопленное и пробуем снова
+    io_uring_sqe* get_sqe()
+    {
+        auto sqe = ring_.get_sqe();
+        if (!sqe)
+        {
+            ring_.submit();
+            sqe = ring_.get_sqe();
+            if (!sqe)
+                throw std::runtime_error("io_uring sq full");
+        }
+
+        if (!flush_pending_)
+        {
+            flush_pending_ = true;
+            flush_.active(EV_TIMEOUT);
+        }
+
+        return sqe;
+    }
+
+    io_uring_sqe* prep(int opcode, int fd, handler_t handler, op*& out)
+    {
+        auto sqe = get_sqe();
+        auto p = new op;
+        p->handler = std::move(handler);
+        ops_.push(p);
+
+        sqe->opcode = static_cast<std::uint8_t>(opcode);
+        sqe->fd = fd;
+        sqe->user_data = reinterpret_cast<std::uint64_t>(p);
+        out = p;
+        return sqe;
+    }
+
+    static void prep_recv(io_uring_sqe *sqe, op *p,
+        int fd, const buf_ring& br) noexcept
+    {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = br.bgid();
+        sqe->user_data = reinterpret_cast<std::uint64_t>(p);
+    }
+
+    void init(queue_pointer queue)
+    {
+        assert(queue);
+
+        efd_.fd = ::eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        if (efd_.fd == code::fail)
+            throw std::system_error(sys::error_code(), "eventfd");
+
+        ring_.register_eventfd(efd_.fd);
+
+        complete_.create(queue, efd_.fd, EV_READ|EV_PERSIST,
+            proxy<reactor>::complete, this);
+        complete_.add();
+
+        flush_.create(queue, -1, EV_TIMEOUT, proxy<reactor>::flush, this);
+    }
+
+    static unsigned check_entries(unsigned entries)
+    {
+        if (!entries)
+            throw std::runtime_error("uring entries not set");
+        return entries;
+    }
+
+public:
+    reactor(queue_pointer queue, unsigned entries, unsigned flags = 0)
+        : ring_(check_entries(entries), flags)
+    {
+        init(queue);
+    }
+
+    // параметры из config::set_uring
+    reactor(queue_pointer queue, const config& conf)
+        : reactor(queue, conf.uring_entries(), conf.uring_flags())
+    {   }
+
+    reactor(const reactor&) = delete;
+    reactor& operator=(const reactor&) = delete;
+
+    reactor& set(throw_t handler)
+    {
+        on_throw_ = std::move(handler);
+        return *this;
+    }
+
+    ring& get_ring() noexcept
+    {
+        return ring_;
+    }
+
+    // отправить подготовленные sqe не дожидаясь конца цикла
+    void flush()
+    {
+        flush_pending_ = false;
+        if (ring_.pending())
+            ring_.submit();
+    }
+
+    // multishot accept, один sqe на все входящие соединения
+    // res - дескриптор нового сокета (SOCK_NONBLOCK|SOCK_CLOEXEC)
+    token_t accept(socket sock, handler_t handler)
+    {
+        assert(sock.good() && handler);
+
+        op *p;
+        auto sqe = prep(IORING_OP_ACCEPT, sock.fd(), std::move(handler), p);
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK|SOCK_CLOEXEC;
+        return sqe->user_data;
+    }
+
+    // multishot recv с буферами из кольца br
+    // буфер возвращается в кольцо после вызова handler
+    // при нехватке буферов (ENOBUFS) операция перезапускается
+    // res == 0 - соединение закрыто, res < 0 - ошибка
+    // -EBUSY - не удалось перезапустить чтение, нет места в кольце
+    token_t recv(socket sock, buf_ring& br, recv_t handler)
+    {
+        assert(sock.good() && handler);
+
+        op *p;
+        auto sqe = prep(IORING_OP_RECV, sock.fd(), handler_t(), p);
+        prep_recv(sqe, p, sock.fd(), br);
+
+        auto fd = sock.fd();
+        p->handler = [this, p, &br, fd, handler](int res, unsigned flags) {
+            if (flags & IORING_CQE_F_BUFFER)
+            {
+                auto bid = static_cast<std::uint16_t>(
+                    flags >> IORING_CQE_BUFFER_SHIFT);
+                try
+                {
+                    handler(res, br.data(bid));
+                }
+                catch (...)
+                {
+                    br.recycle(bid);
+                    throw;
+                }
+                br.recycle(bid);
+            }
+            else if (res != -ENOBUFS)
+                handler(res, nullptr);
+
+            // ядро завершило multishot, запускаем снова с тем же token
+            if (!(flags & IORING_CQE_F_MORE) &&
+                ((res == -ENOBUFS) || (res > 0)))
+            {
+                io_uring_sqe *next = nullptr;
+                try
+                {
+                    next = get_sqe();
+                }
+                catch (...)
+                {   }
+
+                if (next)
+                {
+                    prep_recv(next, p, fd, br);
+                    p->rearm = true;
+                }
+                else
+                {
+                    // кольцо переполнено, чтение завершается с ошибкой
+                    // и операция освобождается
+                    handler(-EBUSY, nullptr);
+                }
+            }
+        };
+
+        return sqe->user_data;
+    }
+
+    // vec должен жить до завершения операции
+    token_t send(socket sock, const iovec *vec, std::size_t count,
+        handler_t handler, int flags = MSG_NOSIGNAL)
+    {
+        assert(sock.good() && vec && count && handler);
+
+        op *p;
+        auto sqe = prep(IORING_OP_SENDMSG, sock.fd(), std::move(handler), p);
+        p->msg.msg_iov = const_cast<iovec*>(vec);
+        p->msg.msg_iovlen = count;
+        sqe->addr = reinterpret_cast<std::uint64_t>(&p->msg);
+        sqe->len = 1;
+        sqe->msg_flags = static_cast<std::uint32_t>(flags);
+        return sqe->user_data;
+    }
+
+    // чтение в буфер зарегистрированный через ring::register_buffers
+    // offset -1 - текущая позиция файла
+    token_t read_fixed(int fd, void *buf, std::size_t len,
+        unsigned buf_index, handler_t handler, std::int64_t offset = -1)
+    {
+        assert(buf && handler);
+
+        op *p;
+        auto sqe = prep(IORING_OP_READ_FIXED, fd, std::move(handler), p);
+        sqe->addr = reinterpret_cast<std::uint64_t>(buf);
+        sqe->len = static_cast<std::uint32_t>(len);
+        sqe->off = static_cast<std::uint64_t>(offset);
+        sqe->buf_index = static_cast<std::uint16_t>(buf_index);
+        return sqe->user_data;
+    }
+
+    token_t write_fixed(int fd, const void *buf, std::size_t len,
+        unsigned buf_index, handler_t handler, std::int64_t offset = -1)
+    {
+        assert(buf && handler);
+
+        op *p;
+        auto sqe = prep(IORING_OP_WRITE_FIXED, fd, std::move(handler), p);
+        sqe->addr = reinterpret_cast<std::uint64_t>(buf);
+        sqe->len = static_cast<std::uint32_t>(len);
+        sqe->off = static_cast<std::uint64_t>(offset);
+        sqe->buf_index = static_cast<std::uint16_t>(buf_index);
+        return sqe->user_data;
+    }
+
+    // отмена операции, ее обработчик получит -ECANCELED
+    // token должен принадлежать еще не завершенной операции
+    void cancel(token_t token)
+    {
+        assert(token);
+        auto sqe = get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = token;
+        sqe->user_data = 0;
+    }
+};
+
+} // namespace uring
+} // namespace btpro
+
+#endif // BTPRO_URING
@@ -0,0 +1,422 @@
+#pragma once
+
+#include "btpro/btpro.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+// experimental
+// требуется ядро 6.0+ (multishot recv, provided buffer ring)
+#ifdef IORING_RECV_MULTISHOT
+#define BTPRO_URING 1
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace btpro {
+namespace uring {
+
+namespace detail {
+
+static inline int setup(unsigned entries, io_uring_params& p) noexcept
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+}
+
+static inline int enter(int fd, unsigned to_submit,
+    unsigned min_complete, unsigned flags) noexcept
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd,
+        to_submit, min_complete, flags, nullptr, 0));
+}
+
+static inline int do_register(int fd, unsigned opcode,
+    const void *arg, unsigned nr_args) noexcept
+{
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd,
+        opcode, arg, nr_args));
+}
+
+template<class T>
+T load_acquire(const T *p) noexcept
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template<class T>
+void store_release(T *p, T v) noexcept
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+template<class T>
+T* offset(void *base, std::size_t off) noexcept
+{
+    return reinterpret_cast<T*>(static_cast<char*>(base) + off);
+}
+
+} // namespace detail
+
+// кольца отправки и завершения io_uring
+// без liburing, только системные вызовы
+// не потокобезопасно, как и queue
+class ring
+{
+    int fd_{-1};
+    io_uring_params params_{};
+
+    void *sq_ptr_{MAP_FAILED};
+    std::size_t sq_size_{};
+    void *cq_ptr_{MAP_FAILED};
+    std::size_t cq_size_{};
+    io_uring_sqe *sqes_{static_cast<io_uring_sqe*>(MAP_FAILED)};
+    std::size_t sqes_size_{};
+
+    unsigned *sq_head_{nullptr};
+    unsigned *sq_tail_{nullptr};
+    unsigned *sq_flags_{nullptr};
+    unsigned *sq_array_{nullptr};
+    unsigned sq_mask_{};
+    unsigned sq_entries_{};
+
+    unsigned *cq_head_{nullptr};
+    unsigned *cq_tail_{nullptr};
+    unsigned cq_mask_{};
+    io_uring_cqe *cqes_{nullptr};
+
+    // локальный хвост, публикуется в submit
+    unsigned sqe_tail_{};
+    unsigned sqe_head_{};
+
+    void map()
+    {
+        auto& sq = params_.sq_off;
+        auto& cq = params_.cq_off;
+
+        sq_size_ = sq.array + params_.sq_entries * sizeof(unsigned);
+        cq_size_ = cq.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+
+        if (params_.features & IORING_FEAT_SINGLE_MMAP)
+            sq_size_ = cq_size_ = (std::max)(sq_size_, cq_size_);
+
+        sq_ptr_ = ::mmap(nullptr, sq_size_, PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED)
+            throw std::system_error(sys::error_code(), "mmap sq");
+
+        if (params_.features & IORING_FEAT_SINGLE_MMAP)
+            cq_ptr_ = sq_ptr_;
+        else
+        {
+            cq_ptr_ = ::mmap(nullptr, cq_size_, PROT_READ|PROT_WRITE,
+                MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+            if (cq_ptr_ == MAP_FAILED)
+                throw std::system_error(sys::error_code(), "mmap cq");
+        }
+
+        sqes_size_ = params_.sq_entries * sizeof(io_uring_sqe);
+        auto sqes = ::mmap(nullptr, sqes_size_, PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            throw std::system_error(sys::error_code(), "mmap sqes");
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        sq_head_ = detail::offset<unsigned>(sq_ptr_, sq.head);
+        sq_tail_ = detail::offset<unsigned>(sq_ptr_, sq.tail);
+        sq_flags_ = detail::offset<unsigned>(sq_ptr_, sq.flags);
+        sq_array_ = detail::offset<unsigned>(sq_ptr_, sq.array);
+        sq_mask_ = *detail::offset<unsigned>(sq_ptr_, sq.ring_mask);
+        sq_entries_ = *detail::offset<unsigned>(sq_ptr_, sq.ring_entries);
+
+        cq_head_ = detail::offset<unsigned>(cq_ptr_, cq.head);
+        cq_tail_ = detail::offset<unsigned>(cq_ptr_, cq.tail);
+        cq_mask_ = *detail::offset<unsigned>(cq_ptr_, cq.ring_mask);
+        cqes_ = detail::offset<io_uring_cqe>(cq_ptr_, cq.cqes);
+
+        sqe_head_ = sqe_tail_ = *sq_tail_;
+    }
+
+    void unmap() noexcept
+    {
+        if (sqes_ != MAP_FAILED)
+            ::munmap(sqes_, sqes_size_);
+        if ((cq_ptr_ != MAP_FAILED) && (cq_ptr_ != sq_ptr_))
+            ::munmap(cq_ptr_, cq_size_);
+        if (sq_ptr_ != MAP_FAILED)
+            ::munmap(sq_ptr_, sq_size_);
+    }
+
+public:
+    explicit ring(unsigned entries, unsigned flags = 0)
+    {
+        assert(entries);
+
+        params_.flags = flags;
+        fd_ = detail::setup(entries, params_);
+        if (fd_ == code::fail)
+            throw std::system_error(sys::error_code(), "io_uring_setup");
+
+        try
+        {
+            map();
+        }
+        catch (...)
+        {
+            unmap();
+            ::close(fd_);
+            throw;
+        }
+    }
+
+    ring(const ring&) = delete;
+    ring& operator=(const ring&) = delete;
+
+    ~ring() noexcept
+    {
+        unmap();
+        ::close(fd_);
+    }
+
+    int fd() const noexcept
+    {
+        return fd_;
+    }
+
+    const io_uring_params& params() const noexcept
+    {
+        return params_;
+    }
+
+    // nullptr - очередь отправки заполнена, нужен submit
+    io_uring_sqe* get_sqe() noexcept
+    {
+        auto head = detail::load_acquire(sq_head_);
+        if (sqe_tail_ - head >= sq_entries_)
+            return nullptr;
+
+        auto sqe = &sqes_[sqe_tail_ & sq_mask_];
+        ++sqe_tail_;
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    // подготовлено но не отправлено в ядро
+    unsigned pending() const noexcept
+    {
+        return sqe_tail_ - sqe_head_;
+    }
+
+    // одним io_uring_enter отправляем все подготовленные sqe
+    int submit(unsigned wait_nr = 0)
+    {
+        auto tail = *sq_tail_;
+        auto count = pending();
+        for (unsigned i = 0; i < count; ++i)
+        {
+            sq_array_[tail & sq_mask_] = sqe_head_ & sq_mask_;
+            ++tail;
+            ++sqe_head_;
+        }
+        detail::store_release(sq_tail_, tail);
+
+        unsigned flags = (wait_nr) ? IORING_ENTER_GETEVENTS : 0;
+        if (params_.flags & IORING_SETUP_SQPOLL)
+        {
+            // поток ядра сам забирает sqe
+            if (!(detail::load_acquire(sq_flags_) & IORING_SQ_NEED_WAKEUP))
+            {
+                if (!wait_nr)
+                    return static_cast<int>(count);
+            }
+            else
+                flags |= IORING_ENTER_SQ_WAKEUP;
+        }
+
+        int res;
+        do
+        {
+            res = detail::enter(fd_, count, wait_nr, flags);
+        } while ((res == code::fail) && (sys::error() == EINTR));
+
+        if (res == code::fail)
+            throw std::system_error(sys::error_code(), "io_uring_enter");
+
+        return res;
+    }
+
+    // обработать готовые завершения
+    template<class F>
+    unsigned reap(F&& fn)
+    {
+        unsigned count = 0;
+        auto head = *cq_head_;
+        auto tail = detail::load_acquire(cq_tail_);
+        while (head != tail)
+        {
+            // копия, слот вернется ядру раньше чем отработает fn
+            auto cqe = cqes_[head & cq_mask_];
+            ++head;
+            detail::store_release(cq_head_, head);
+            fn(cqe);
+            ++count;
+
+            if (head == tail)
+                tail = detail::load_acquire(cq_tail_);
+        }
+        return count;
+    }
+
+    void register_eventfd(int efd)
+    {
+        if (detail::do_register(fd_, IORING_REGISTER_EVENTFD,
+            &efd, 1) == code::fail)
+        {
+            throw std::system_error(sys::error_code(),
+                "IORING_REGISTER_EVENTFD");
+        }
+    }
+
+    void register_buffers(const iovec *vec, unsigned count)
+    {
+        assert(vec && count);
+        if (detail::do_register(fd_, IORING_REGISTER_BUFFERS,
+            vec, count) == code::fail)
+        {
+            throw std::system_error(sys::error_code(),
+                "IORING_REGISTER_BUFFERS");
+        }
+    }
+
+    void unregister_buffers() noexcept
+    {
+        detail::do_register(fd_, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+    }
+
+    void register_buf_ring(const io_uring_buf_reg& reg)
+    {
+        if (detail::do_register(fd_, IORING_REGISTER_PBUF_RING,
+            &reg, 1) == code::fail)
+        {
+            throw std::system_error(sys::error_code(),
+                "IORING_REGISTER_PBUF_RING");
+        }
+    }
+
+    void unregister_buf_ring(std::uint16_t bgid) noexcept
+    {
+        io_uring_buf_reg reg{};
+        reg.bgid = bgid;
+        detail::do_register(fd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+};
+
+// кольцо буферов для recv с IOSQE_BUFFER_SELECT
+// ядро само выбирает буфер, приложение возвращает его после обработки
+class buf_ring
+{
+    ring& ring_;
+    std::uint16_t bgid_{};
+    unsigned entries_{};
+    std::size_t buf_size_{};
+    std::size_t mem_size_{};
+    // io_uring_buf_ring в C++ не годится
+    // пустая структура в __DECLARE_FLEX_ARRAY сдвигает bufs на 8 байт
+    // хвост кольца лежит в bufs_[0].resv
+    io_uring_buf *bufs_{nullptr};
+    char *data_{nullptr};
+    std::uint16_t tail_{};
+
+    void add(std::uint16_t bid, unsigned i) noexcept
+    {
+        auto& buf = bufs_[(tail_ + i) & (entries_ - 1)];
+        buf.addr = reinterpret_cast<std::uint64_t>(data(bid));
+        buf.len = static_cast<std::uint32_t>(buf_size_);
+        buf.bid = bid;
+    }
+
+    void advance(unsigned count) noexcept
+    {
+        tail_ = static_cast<std::uint16_t>(tail_ + count);
+        detail::store_release(&bufs_[0].resv, tail_);
+    }
+
+public:
+    // entries - степень двойки, не больше 32768
+    buf_ring(ring& r, std::uint16_t bgid,
+        unsigned entries, std::size_t buf_size)
+        : ring_(r)
+        , bgid_(bgid)
+        , entries_(entries)
+        , buf_size_(buf_size)
+    {
+        assert(entries && !(entries & (entries - 1)) && (entries <= 32768));
+        assert(buf_size);
+
+        mem_size_ = entries * (sizeof(io_uring_buf) + buf_size);
+        auto mem = ::mmap(nullptr, mem_size_, PROT_READ|PROT_WRITE,
+            MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+        if (mem == MAP_FAILED)
+            throw std::system_error(sys::error_code(), "mmap buf_ring");
+
+        bufs_ = static_cast<io_uring_buf*>(mem);
+        data_ = static_cast<char*>(mem) + entries * sizeof(io_uring_buf);
+
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<std::uint64_t>(bufs_);
+        reg.ring_entries = entries;
+        reg.bgid = bgid;
+
+        try
+        {
+            ring_.register_buf_ring(reg);
+        }
+        catch (...)
+        {
+            ::munmap(mem, mem_size_);
+            throw;
+        }
+
+        for (unsigned i = 0; i < entries; ++i)
+            add(static_cast<std::uint16_t>(i), i);
+        advance(entries);
+    }
+
+    buf_ring(const buf_ring&) = delete;
+    buf_ring& operator=(const buf_ring&) = delete;
+
+    ~buf_ring() noexcept
+    {
+        ring_.unregister_buf_ring(bgid_);
+        ::munmap(bufs_, mem_size_);
+    }
+
+    std::uint16_t bgid() const noexcept
+    {
+        return bgid_;
+    }
+
+    std::size_t buf_size() const noexcept
+    {
+        return buf_size_;
+    }
+
+    char* data(std::uint16_t bid) const noexcept
+    {
+        assert(bid < entries_);
+        return data_ + bid * buf_size_;
+    }
+
+    // вернуть буфер ядру
+    void recycle(std::uint16_t bid) noexcept
+    {
+        add(bid, 0);
+        advance(1);
+    }
+};
+
+} // namespace uring
+} // namespace btpro
+
+#endif // IORING_RECV_MULTISHOT
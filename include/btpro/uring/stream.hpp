@@ -0,0 +1,205 @@
+#pragma once
+
+#include "btpro/uring/reactor.hpp"
+#include "btpro/buffer.hpp"
+
+#ifdef BTPRO_URING
+
+#include <memory>
+
+namespace btpro {
+namespace uring {
+
+// соединение поверх reactor, аналог tcp::bev
+// чтение - multishot recv с буферами из buf_ring
+// запись - sendmsg прямо из сегментов evbuffer без копирования
+// активное чтение держит ссылку на stream, освобождается после disable
+// или закрытия соединения
+class stream
+    : public std::enable_shared_from_this<stream>
+{
+public:
+    typedef std::function<void(stream&, buffer_ref)> recv_t;
+    typedef std::function<void(stream&)> send_t;
+    // 0 - соединение закрыто, иначе код ошибки
+    typedef std::function<void(stream&, int)> event_t;
+
+    constexpr static std::size_t max_iov = 16;
+
+private:
+    reactor& reactor_;
+    buf_ring& br_;
+    socket sock_;
+    buffer input_{};
+    buffer output_{};
+    // данные в ядре, не меняются до завершения sendmsg
+    buffer inflight_{};
+    iovec iov_[max_iov];
+    reactor::token_t recv_token_{};
+    // номер запуска чтения, завершения отмененного чтения не наши
+    std::uint64_t recv_gen_{};
+    bool sending_{false};
+    recv_t on_recv_{};
+    send_t on_send_{};
+    event_t on_event_{};
+
+    struct key {};
+
+    void on_event(int err)
+    {
+        if (on_event_)
+            on_event_(*this, err);
+    }
+
+    void do_send()
+    {
+        if (inflight_.empty())
+            inflight_.append(std::move(output_));
+
+        auto count = evbuffer_peek(inflight_, -1, nullptr,
+            reinterpret_cast<evbuffer_iovec*>(iov_), max_iov);
+        assert(count > 0);
+
+        sending_ = true;
+        auto self = shared_from_this();
+        reactor_.send(sock_, iov_, (std::min)(static_cast<std::size_t>(count),
+            max_iov), [self](int res, unsigned) {
+                self->sent(res);
+            });
+    }
+
+    void sent(int res)
+    {
+        sending_ = false;
+        if (res < 0)
+        {
+            on_event(-res);
+            return;
+        }
+
+        inflight_.drain(static_cast<std::size_t>(res));
+        if (!inflight_.empty() || !output_.empty())
+            do_send();
+        else if (on_send_)
+            on_send_(*this);
+    }
+
+public:
+    stream(key, reactor& r, buf_ring& br, socket sock)
+        : reactor_(r)
+        , br_(br)
+        , sock_(sock)
+    {
+        static_assert(sizeof(iovec) == sizeof(evbuffer_iovec));
+        assert(sock.good());
+    }
+
+    static std::shared_ptr<stream> create(reactor& r,
+        buf_ring& br, socket sock)
+    {
+        return std::make_shared<stream>(key(), r, br, sock);
+    }
+
+    stream(const stream&) = delete;
+    stream& operator=(const stream&) = delete;
+
+    ~stream() noexcept
+    {
+        sock_.close();
+    }
+
+    stream& set(recv_t fn)
+    {
+        on_recv_ = std::move(fn);
+        return *this;
+    }
+
+    stream& set(send_t fn)
+    {
+        on_send_ = std::move(fn);
+        return *this;
+    }
+
+    stream& set(event_t fn)
+    {
+        on_event_ = std::move(fn);
+        return *this;
+    }
+
+    socket sock() const noexcept
+    {
+        return sock_;
+    }
+
+    buffer_ref input() const noexcept
+    {
+        return input_;
+    }
+
+    buffer_ref output() const noexcept
+    {
+        return output_;
+    }
+
+    // запустить чтение
+    void enable()
+    {
+        if (recv_token_)
+            return;
+
+        auto self = shared_from_this();
+        auto gen = ++recv_gen_;
+        recv_token_ = reactor_.recv(sock_, br_,
+            [self, gen](int res, const char *data) {
+                auto current = (gen == self->recv_gen_);
+                if (res > 0)
+                {
+                    // данные уже сняты с сокета, сохраняем их в любом случае
+                    self->input_.append(data, static_cast<std::size_t>(res));
+                    if (current && self->on_recv_)
+                        self->on_recv_(*self, self->input_);
+                }
+                else if (current)
+                {
+                    self->recv_token_ = 0;
+                    self->on_event(-res);
+                }
+            });
+    }
+
+    // остановить чтение
+    // завершение отмененной операции (ECANCELED) обработчику не передается
+    void disable()
+    {
+        if (recv_token_)
+        {
+            reactor_.cancel(recv_token_);
+            recv_token_ = 0;
+            ++recv_gen_;
+        }
+    }
+
+    // отправить все что накоплено в output
+    void flush()
+    {
+        if (!sending_ && !output_.empty())
+            do_send();
+    }
+
+    void write(buffer buf)
+    {
+        output_.append(std::move(buf));
+        flush();
+    }
+
+    void write(const void *data, std::size_t len)
+    {
+        output_.append(data, len);
+        flush();
+    }
+};
+
+} // namespace uring
+} // namespace btpro
+
+#endif // BTPRO_URING
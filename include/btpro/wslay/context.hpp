@@ -1,6 +1,6 @@
 #pragma once
 
-#include "btpro/ssl/rand.hpp"
+#include "btpro/wslay/frame.hpp"
 #include "wslay/wslay.h"
 
 namespace btpro {
@@ -80,15 +80,18 @@ class context
             return static_cast<F*>(self)->call_receive(data, len);
         }
 
+        // ключи из пачки, а не RAND_bytes на каждый кадр
         static int genmask(wslay_event_context_ptr ctx,
-            uint8_t *buf, size_t len, void*)
+            uint8_t *buf, size_t len, void*) noexcept
         {
-            ssl::rand rnd;
-            auto rc = rnd(buf, len);
-            if (rc == -1)
+            try
+            {
+                mask_source::local()(buf, len);
+            }
+            catch (...)
             {
                 wslay_event_set_error(ctx, WSLAY_ERR_CALLBACK_FAILURE);
-                return rc;
+                return -1;
             }
 
             return 0;
@@ -196,6 +199,19 @@ public:
             throw std::runtime_error("wslay_event_queue_msg");
     }
 
+    // rsv - WSLAY_RSV1_BIT для сжатого сообщения
+    void queue_msg(const wslay_event_msg& msg, uint8_t rsv)
+    {
+        if (wslay_event_queue_msg_ex(assert_handle(), &msg, rsv) != 0)
+            throw std::runtime_error("wslay_event_queue_msg_ex");
+    }
+
+    // биты rsv которые разрешены во входящих кадрах
+    void set_allowed_rsv_bits(uint8_t rsv)
+    {
+        wslay_event_config_set_allowed_rsv_bits(assert_handle(), rsv);
+    }
+
     void queue_text(std::string_view text)
     {
         wslay_event_msg msg = {
@@ -0,0 +1,424 @@
+#pragma once
+
+#include "btpro/wslay/handshake.hpp"
+
+#include <zlib.h>
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cassert>
+
+namespace btpro {
+namespace wslay {
+
+// параметры permessage-deflate (rfc 7692)
+struct deflate_params
+{
+    // словарь сбрасывается после каждого сообщения
+    bool server_no_context_takeover{false};
+    bool client_no_context_takeover{false};
+    // 9..15
+    int server_max_window_bits{15};
+    int client_max_window_bits{15};
+    // клиент разрешил ограничить свое окно
+    bool client_bits_offered{true};
+    // сообщения короче отправляются без сжатия
+    std::size_t threshold{256};
+    int level{Z_DEFAULT_COMPRESSION};
+    int mem_level{8};
+
+    // значение Sec-WebSocket-Extensions
+    std::string to_string(bool offer) const
+    {
+        using namespace std::literals;
+
+        std::string rc("permessage-deflate"sv);
+        if (server_no_context_takeover)
+            rc += "; server_no_context_takeover"sv;
+        if (client_no_context_takeover)
+            rc += "; client_no_context_takeover"sv;
+        if (server_max_window_bits < 15)
+        {
+            rc += "; server_max_window_bits="sv;
+            rc += std::to_string(server_max_window_bits);
+        }
+        if (offer)
+        {
+            rc += "; client_max_window_bits"sv;
+            if (client_max_window_bits < 15)
+            {
+                rc += '=';
+                rc += std::to_string(client_max_window_bits);
+            }
+        }
+        else if (client_max_window_bits < 15)
+        {
+            rc += "; client_max_window_bits="sv;
+            rc += std::to_string(client_max_window_bits);
+        }
+        return rc;
+    }
+
+    // одно предложение или ответ без запятых
+    // false - не permessage-deflate или неверные параметры
+    bool parse(std::string_view value)
+    {
+        auto f = value.find(';');
+        if (!handshake::iequal(handshake::trim(value.substr(0, f)),
+            "permessage-deflate"))
+        {
+            return false;
+        }
+
+        server_no_context_takeover = false;
+        client_no_context_takeover = false;
+        server_max_window_bits = 15;
+        client_max_window_bits = 15;
+        client_bits_offered = false;
+
+        while (f != std::string_view::npos)
+        {
+            value.remove_prefix(f + 1);
+            f = value.find(';');
+
+            auto param = handshake::trim(value.substr(0, f));
+            auto eq = param.find('=');
+            auto name = handshake::trim(param.substr(0, eq));
+            auto arg = (eq == std::string_view::npos) ?
+                std::string_view() : handshake::trim(param.substr(eq + 1));
+            if ((arg.size() >= 2) && (arg.front() == '"') && (arg.back() == '"'))
+                arg = arg.substr(1, arg.size() - 2);
+
+            if (handshake::iequal(name, "server_no_context_takeover"))
+                server_no_context_takeover = true;
+            else if (handshake::iequal(name, "client_no_context_takeover"))
+                client_no_context_takeover = true;
+            else if (handshake::iequal(name, "server_max_window_bits"))
+            {
+                server_max_window_bits = bits(arg);
+                if (!server_max_window_bits)
+                    return false;
+            }
+            else if (handshake::iequal(name, "client_max_window_bits"))
+            {
+                client_bits_offered = true;
+                client_max_window_bits = (arg.empty()) ? 15 : bits(arg);
+                if (!client_max_window_bits)
+                    return false;
+            }
+            else
+                return false;
+        }
+
+        return true;
+    }
+
+    // ответ сервера на предложение клиента
+    deflate_params accept(const deflate_params& offer) const noexcept
+    {
+        auto rc = *this;
+        rc.server_no_context_takeover |= offer.server_no_context_takeover;
+        rc.client_no_context_takeover |= offer.client_no_context_takeover;
+        rc.server_max_window_bits = (std::min)(server_max_window_bits,
+            offer.server_max_window_bits);
+        // окно клиента ограничиваем только с его разрешения
+        rc.client_max_window_bits = (offer.client_bits_offered) ?
+            (std::min)(client_max_window_bits, offer.client_max_window_bits) : 15;
+        return rc;
+    }
+
+private:
+    // окно 8 zlib для deflate не поддерживает, такое предложение отклоняем
+    static int bits(std::string_view arg) noexcept
+    {
+        if ((arg.size() == 1) && (arg[0] == '9'))
+            return 9;
+        if ((arg.size() == 2) && (arg[0] == '1') && (arg[1] >= '0') && (arg[1] <= '5'))
+            return 10 + (arg[1] - '0');
+        return 0;
+    }
+};
+
+// поток zlib, deflateInit выделяет сотни килобайт
+class zstream
+{
+    z_stream z_{};
+    bool deflate_{};
+    int bits_{};
+    int level_{};
+
+public:
+    zstream(bool deflate, int bits, int level, int mem_level)
+        : deflate_(deflate)
+        , bits_(bits)
+        , level_(level)
+    {
+        auto rc = (deflate) ?
+            deflateInit2(&z_, level, Z_DEFLATED, -bits,
+                mem_level, Z_DEFAULT_STRATEGY) :
+            inflateInit2(&z_, -bits);
+        if (rc != Z_OK)
+            throw std::runtime_error((deflate) ? "deflateInit2" : "inflateInit2");
+    }
+
+    zstream(const zstream&) = delete;
+    zstream& operator=(const zstream&) = delete;
+
+    ~zstream() noexcept
+    {
+        if (deflate_)
+            deflateEnd(&z_);
+        else
+            inflateEnd(&z_);
+    }
+
+    bool same(bool deflate, int bits, int level) const noexcept
+    {
+        return (deflate_ == deflate) && (bits_ == bits) &&
+            (!deflate || (level_ == level));
+    }
+
+    void reset() noexcept
+    {
+        if (deflate_)
+            deflateReset(&z_);
+        else
+            inflateReset(&z_);
+    }
+
+    z_stream* get() noexcept
+    {
+        return &z_;
+    }
+};
+
+using zstream_ptr = std::unique_ptr<zstream>;
+
+// сброшенные потоки zlib для повторного использования
+// без блокировок, один пул на поток
+class zstream_pool
+{
+    std::vector<zstream_ptr> free_{};
+    std::size_t max_{64};
+
+public:
+    zstream_pool() = default;
+
+    explicit zstream_pool(std::size_t max)
+        : max_(max)
+    {   }
+
+    zstream_ptr acquire(bool deflate, int bits, int level, int mem_level)
+    {
+        auto f = std::find_if(free_.rbegin(), free_.rend(),
+            [&](const zstream_ptr& z) {
+                return z->same(deflate, bits, level);
+            });
+
+        if (f == free_.rend())
+            return zstream_ptr(new zstream(deflate, bits, level, mem_level));
+
+        auto rc = std::move(*f);
+        free_.erase(std::next(f).base());
+        return rc;
+    }
+
+    void release(zstream_ptr z) noexcept
+    {
+        if (z && (free_.size() < max_))
+        {
+            z->reset();
+            try
+            {
+                free_.push_back(std::move(z));
+            }
+            catch (...)
+            {   }
+        }
+    }
+
+    std::size_t size() const noexcept
+    {
+        return free_.size();
+    }
+};
+
+// сжатие сообщений одного соединения
+// без context takeover поток берется из пула на одно сообщение
+class permessage_deflate
+{
+    std::shared_ptr<zstream_pool> pool_;
+    deflate_params params_;
+    bool server_;
+    zstream_ptr tx_{};
+    zstream_ptr rx_{};
+
+    bool tx_reset() const noexcept
+    {
+        return (server_) ? params_.server_no_context_takeover :
+            params_.client_no_context_takeover;
+    }
+
+    bool rx_reset() const noexcept
+    {
+        return (server_) ? params_.client_no_context_takeover :
+            params_.server_no_context_takeover;
+    }
+
+    int tx_bits() const noexcept
+    {
+        return (server_) ? params_.server_max_window_bits :
+            params_.client_max_window_bits;
+    }
+
+    int rx_bits() const noexcept
+    {
+        return (server_) ? params_.client_max_window_bits :
+            params_.server_max_window_bits;
+    }
+
+    static void grow(std::string& out, std::size_t pos, std::size_t hint)
+    {
+        out.resize(pos + (std::max)(hint, std::size_t{1024}));
+    }
+
+public:
+    permessage_deflate(std::shared_ptr<zstream_pool> pool,
+        const deflate_params& params, bool server)
+        : pool_(std::move(pool))
+        , params_(params)
+        , server_(server)
+    {
+        assert(pool_);
+    }
+
+    permessage_deflate(const permessage_deflate&) = delete;
+    permessage_deflate& operator=(const permessage_deflate&) = delete;
+
+    ~permessage_deflate() noexcept
+    {
+        pool_->release(std::move(tx_));
+        pool_->release(std::move(rx_));
+    }
+
+    const deflate_params& params() const noexcept
+    {
+        return params_;
+    }
+
+    // сжатое сообщение не зависит от предыдущих
+    // такой кадр можно рассылать многим клиентам
+    bool stateless() const noexcept
+    {
+        return tx_reset();
+    }
+
+    // false - короче порога или без выигрыша, отправлять как есть
+    bool compress(std::string_view in, std::string& out)
+    {
+        if (in.size() < params_.threshold)
+            return false;
+
+        if (!tx_)
+            tx_ = pool_->acquire(true, tx_bits(), params_.level, params_.mem_level);
+
+        auto z = tx_->get();
+        z->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        z->avail_in = static_cast<uInt>(in.size());
+
+        std::size_t pos = 0;
+        grow(out, 0, deflateBound(z, z->avail_in) + 8);
+        do
+        {
+            if (pos == out.size())
+                grow(out, pos, out.size());
+
+            z->next_out = reinterpret_cast<Bytef*>(out.data() + pos);
+            z->avail_out = static_cast<uInt>(out.size() - pos);
+            auto rc = deflate(z, Z_SYNC_FLUSH);
+            if ((rc != Z_OK) && (rc != Z_BUF_ERROR))
+                throw std::runtime_error("deflate");
+            pos = out.size() - z->avail_out;
+        } while (z->avail_in || !z->avail_out);
+
+        // хвост 00 00 ff ff не передается
+        assert(pos >= 4);
+        pos -= 4;
+        out.resize(pos);
+
+        // с context takeover данные уже в словаре, отправлять только сжатыми
+        if (!tx_reset())
+            return true;
+
+        pool_->release(std::move(tx_));
+        return pos < in.size();
+    }
+
+    // max - предел размера сообщения, 0 - без предела
+    void decompress(std::string_view in, std::string& out, std::size_t max = 0)
+    {
+        static const Bytef tail[] = { 0x00, 0x00, 0xff, 0xff };
+
+        if (!rx_)
+            rx_ = pool_->acquire(false, 15, 0, 0);
+
+        auto z = rx_->get();
+        std::size_t pos = 0;
+        grow(out, 0, in.size() * 4);
+
+        // поток завершен блоком с BFINAL, хвост уже не нужен
+        bool end = false;
+        for (int part = 0; (part < 2) && !end; ++part)
+        {
+            if (part)
+            {
+                z->next_in = const_cast<Bytef*>(tail);
+                z->avail_in = sizeof(tail);
+            }
+            else
+            {
+                z->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+                z->avail_in = static_cast<uInt>(in.size());
+            }
+
+            while (z->avail_in)
+            {
+                if (pos == out.size())
+                    grow(out, pos, out.size());
+
+                z->next_out = reinterpret_cast<Bytef*>(out.data() + pos);
+                z->avail_out = static_cast<uInt>(out.size() - pos);
+                auto rc = inflate(z, Z_SYNC_FLUSH);
+                if ((rc != Z_OK) && (rc != Z_BUF_ERROR) && (rc != Z_STREAM_END))
+                    throw std::runtime_error("inflate");
+                pos = out.size() - z->avail_out;
+
+                if (max && (pos > max))
+                    throw std::runtime_error("inflate message too large");
+
+                if (rc == Z_STREAM_END)
+                {
+                    // следующее сообщение начинает новый поток
+                    inflateReset(z);
+                    if (z->avail_in)
+                        throw std::runtime_error("inflate trailing data");
+                    end = true;
+                    break;
+                }
+
+                if ((rc == Z_BUF_ERROR) && z->avail_out)
+                    break;
+            }
+        }
+
+        out.resize(pos);
+
+        if (rx_reset())
+            pool_->release(std::move(rx_));
+    }
+};
+
+} // namespace wslay
+} // namespace btpro
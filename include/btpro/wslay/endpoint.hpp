@@ -0,0 +1,695 @@
+#pragma once
+
+#include "btpro/tcp/bevfn.hpp"
+#include "btpro/wslay/context.hpp"
+#include "btpro/wslay/handshake.hpp"
+#include "btpro/wslay/deflate.hpp"
+
+#include <functional>
+
+namespace btpro {
+namespace wslay {
+
+// websocket поверх tcp::bev или ssl::bevtls без curl
+// upgrade выполняем сами, кадры читаются из input evbuffer
+// и пишутся сразу в свободное место output evbuffer
+// bev принадлежит вызывающему и должен жить дольше endpoint
+class endpoint
+{
+public:
+    enum class state
+    {
+        idle,
+        handshake,
+        open,
+        // ждем отправки последних данных
+        closing,
+        closed
+    };
+
+    using open_fn_type = std::function<void()>;
+    // opcode - WSLAY_TEXT_FRAME или WSLAY_BINARY_FRAME
+    // данные живут только на время вызова
+    using message_fn_type = std::function<void(std::uint8_t opcode,
+        std::string_view data)>;
+    // код закрытия, 1006 - соединение оборвано без close
+    using close_fn_type = std::function<void(std::uint16_t status)>;
+    // сервер: target запроса и Sec-WebSocket-Protocol клиента
+    // в protocol выбранный протокол, false - отказ с 403
+    using accept_fn_type = std::function<bool(std::string_view target,
+        std::string_view protocols, std::string& protocol)>;
+
+private:
+    tcp::bev& bev_;
+    context<endpoint> wslay_{*this};
+
+    state state_{state::idle};
+    bool server_{false};
+    // внутри wslay_event_recv запись откладывается
+    bool in_recv_{false};
+    std::uint16_t close_status_{1006};
+    std::uint64_t max_message_{};
+    // сколько резервировать в output за один вызов wslay_event_write
+    std::size_t chunk_{16384};
+
+    std::string key_{};
+    std::string host_{};
+    std::string target_{};
+    std::string protocol_{};
+
+    // permessage-deflate: желаемые параметры и согласованное сжатие
+    std::shared_ptr<zstream_pool> zpool_{};
+    deflate_params zparams_{};
+    std::unique_ptr<permessage_deflate> deflate_{};
+    // буферы сжатия и распаковки, емкость сохраняется
+    std::string ztx_{};
+    std::string zrx_{};
+
+    open_fn_type open_fn_{};
+    message_fn_type message_fn_{};
+    close_fn_type close_fn_{};
+    accept_fn_type accept_fn_{};
+
+    void finish(std::uint16_t status) noexcept
+    {
+        if (state_ == state::closed)
+            return;
+
+        state_ = state::closed;
+        try
+        {
+            bev_.disable(EV_READ|EV_WRITE);
+        }
+        catch (...)
+        {   }
+
+        try
+        {
+            if (close_fn_)
+                close_fn_(status);
+        }
+        catch (...)
+        {   }
+    }
+
+    // закрыть после отправки того что уже в output
+    void shutdown(std::uint16_t status)
+    {
+        close_status_ = status;
+        if (bev_.output().empty())
+            finish(status);
+        else
+        {
+            state_ = state::closing;
+            bev_.disable(EV_READ);
+        }
+    }
+
+    void send_head(std::string_view head)
+    {
+        bev_.output().append(head.data(), head.size());
+    }
+
+    void open()
+    {
+        if (server_)
+            wslay_.server();
+        else
+            wslay_.client();
+
+        if (max_message_)
+            wslay_.set_max_recv_msg_length(max_message_);
+
+        if (deflate_)
+            wslay_.set_allowed_rsv_bits(WSLAY_RSV1_BIT);
+
+        state_ = state::open;
+        if (open_fn_)
+            open_fn_();
+    }
+
+    void check_response(std::string_view head)
+    {
+        bool upgrade = false;
+        bool connection = false;
+        std::string_view accept;
+        std::string_view protocol;
+        std::string_view extensions;
+
+        auto first = handshake::parse(head,
+            [&](std::string_view key, std::string_view value) {
+                if (handshake::iequal(key, "upgrade"))
+                    upgrade = handshake::iequal(value, "websocket");
+                else if (handshake::iequal(key, "connection"))
+                    connection = handshake::has_token(value, "upgrade");
+                else if (handshake::iequal(key, "sec-websocket-accept"))
+                    accept = value;
+                else if (handshake::iequal(key, "sec-websocket-protocol"))
+                    protocol = value;
+                else if (handshake::iequal(key, "sec-websocket-extensions"))
+                    extensions = value;
+            });
+
+        if (handshake::status(first) != 101)
+            throw std::runtime_error("websocket upgrade status");
+
+        if (!upgrade || !connection ||
+            (accept != handshake::accept_key(key_)))
+        {
+            throw std::runtime_error("websocket upgrade accept");
+        }
+
+        // сервер может выбрать только из предложенных
+        if (!protocol.empty() && !handshake::has_token(protocol_, protocol))
+            throw std::runtime_error("websocket upgrade protocol");
+
+        protocol_.assign(protocol);
+
+        deflate_.reset();
+        if (!extensions.empty())
+        {
+            // расширение которое мы не предлагали
+            deflate_params params;
+            if (!zpool_ || !params.parse(extensions))
+                throw std::runtime_error("websocket upgrade extensions");
+
+            params.threshold = zparams_.threshold;
+            params.level = zparams_.level;
+            params.mem_level = zparams_.mem_level;
+            deflate_.reset(new permessage_deflate(zpool_, params, false));
+        }
+    }
+
+    // первое подходящее предложение permessage-deflate
+    void accept_deflate(std::string_view offers)
+    {
+        deflate_.reset();
+        if (!zpool_)
+            return;
+
+        while (!offers.empty())
+        {
+            auto f = offers.find(',');
+            deflate_params offer;
+            if (offer.parse(offers.substr(0, f)))
+            {
+                deflate_.reset(new permessage_deflate(zpool_,
+                    zparams_.accept(offer), true));
+                return;
+            }
+
+            if (f == std::string_view::npos)
+                break;
+            offers.remove_prefix(f + 1);
+        }
+    }
+
+    // false - запрос отклонен, ответ с ошибкой уже в output
+    bool check_request(std::string_view head)
+    {
+        using namespace std::literals;
+
+        bool upgrade = false;
+        bool connection = false;
+        bool version = false;
+        std::string_view key;
+        std::string_view protocols;
+        std::string_view extensions;
+
+        auto first = handshake::parse(head,
+            [&](std::string_view k, std::string_view value) {
+                if (handshake::iequal(k, "upgrade"))
+                    upgrade = handshake::has_token(value, "websocket");
+                else if (handshake::iequal(k, "connection"))
+                    connection = handshake::has_token(value, "upgrade");
+                else if (handshake::iequal(k, "sec-websocket-version"))
+                    version = (value == "13"sv);
+                else if (handshake::iequal(k, "sec-websocket-key"))
+                    key = value;
+                else if (handshake::iequal(k, "sec-websocket-protocol"))
+                    protocols = value;
+                else if (handshake::iequal(k, "sec-websocket-extensions"))
+                    extensions = value;
+            });
+
+        auto target = handshake::target(first);
+        if (target.empty() || !upgrade || !connection || key.empty())
+        {
+            send_head("HTTP/1.1 400 Bad Request\r\n"
+                "Connection: close\r\nContent-Length: 0\r\n\r\n"sv);
+            return false;
+        }
+
+        if (!version)
+        {
+            send_head("HTTP/1.1 426 Upgrade Required\r\n"
+                "Sec-WebSocket-Version: 13\r\n"
+                "Connection: close\r\nContent-Length: 0\r\n\r\n"sv);
+            return false;
+        }
+
+        target_.assign(target);
+        protocol_.clear();
+        if (accept_fn_ && !accept_fn_(target, protocols, protocol_))
+        {
+            send_head("HTTP/1.1 403 Forbidden\r\n"
+                "Connection: close\r\nContent-Length: 0\r\n\r\n"sv);
+            return false;
+        }
+
+        std::string resp;
+        resp.reserve(160);
+        resp += "HTTP/1.1 101 Switching Protocols\r\n"
+            "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Accept: "sv;
+        resp += handshake::accept_key(key);
+        if (!protocol_.empty())
+        {
+            resp += "\r\nSec-WebSocket-Protocol: "sv;
+            resp += protocol_;
+        }
+        accept_deflate(extensions);
+        if (deflate_)
+        {
+            resp += "\r\nSec-WebSocket-Extensions: "sv;
+            resp += deflate_->params().to_string(false);
+        }
+        resp += "\r\n\r\n"sv;
+        send_head(resp);
+
+        return true;
+    }
+
+    // false - заголовок еще не пришел целиком
+    bool read_head()
+    {
+        auto input = bev_.input();
+        auto pos = input.search("\r\n\r\n", 4);
+        if (pos < 0)
+        {
+            if (input.size() > handshake::max_head)
+                throw std::runtime_error("websocket head too large");
+            return false;
+        }
+
+        auto len = static_cast<std::size_t>(pos) + 4;
+        if (len > handshake::max_head)
+            throw std::runtime_error("websocket head too large");
+
+        auto ptr = input.pullup(static_cast<ev_ssize_t>(len));
+        std::string_view head(reinterpret_cast<const char*>(ptr), len);
+
+        if (server_)
+        {
+            if (!check_request(head))
+            {
+                input.drain(input.size());
+                shutdown(1002);
+                return false;
+            }
+        }
+        else
+            check_response(head);
+
+        // за заголовком могут сразу идти кадры
+        input.drain(len);
+        open();
+
+        return true;
+    }
+
+    // true - сообщение сжато и поставлено в очередь
+    bool queue_deflate(std::uint8_t opcode, std::string_view data)
+    {
+        if (!deflate_ || !deflate_->compress(data, ztx_))
+            return false;
+
+        wslay_event_msg msg = { opcode,
+            reinterpret_cast<const uint8_t*>(ztx_.data()), ztx_.size() };
+        wslay_.queue_msg(msg, WSLAY_RSV1_BIT);
+        return true;
+    }
+
+    // кадры из очереди wslay сразу в output evbuffer
+    void flush()
+    {
+        if (in_recv_ || (state_ != state::open))
+            return;
+
+        auto output = bev_.output().handle();
+        while (wslay_.want_write())
+        {
+            evbuffer_iovec vec;
+            if (evbuffer_reserve_space(output,
+                static_cast<ev_ssize_t>(chunk_), &vec, 1) < 1)
+            {
+                throw std::runtime_error("evbuffer_reserve_space");
+            }
+
+            auto rc = wslay_.write(static_cast<std::uint8_t*>(vec.iov_base),
+                vec.iov_len);
+            if (rc < 0)
+                throw std::runtime_error("wslay_event_write");
+
+            vec.iov_len = static_cast<std::size_t>(rc);
+            if (evbuffer_commit_space(output, &vec, 1) == code::fail)
+                throw std::runtime_error("evbuffer_commit_space");
+
+            if (!rc)
+                break;
+        }
+
+        // close отправлен и получен
+        if (!wslay_.want_read() && !wslay_.want_write())
+            shutdown(close_status_);
+    }
+
+    void do_recv() noexcept
+    {
+        try
+        {
+            if ((state_ == state::handshake) && !read_head())
+                return;
+
+            if (state_ != state::open)
+                return;
+
+            in_recv_ = true;
+            try
+            {
+                wslay_.receive();
+            }
+            catch (...)
+            {
+                in_recv_ = false;
+                throw;
+            }
+            in_recv_ = false;
+
+            flush();
+        }
+        catch (...)
+        {
+            finish(1002);
+        }
+    }
+
+    void do_send() noexcept
+    {
+        if ((state_ == state::closing) && bev_.output().empty())
+            finish(close_status_);
+    }
+
+    void do_connect() noexcept
+    {
+        try
+        {
+            upgrade();
+        }
+        catch (...)
+        {
+            finish(1006);
+        }
+    }
+
+    void do_event(short what) noexcept
+    {
+        if (what & (BEV_EVENT_EOF|BEV_EVENT_ERROR|BEV_EVENT_TIMEOUT))
+        {
+            finish((state_ == state::closing) ?
+                close_status_ : std::uint16_t{1006});
+        }
+    }
+
+    using bevfn_type = tcp::bevfn<endpoint, &endpoint::do_recv,
+        &endpoint::do_send, &endpoint::do_event, &endpoint::do_connect>;
+
+public:
+    endpoint(tcp::bev& bev) noexcept
+        : bev_(bev)
+    {   }
+
+    endpoint(const endpoint&) = delete;
+    endpoint& operator=(const endpoint&) = delete;
+
+    ~endpoint() noexcept
+    {
+        if (bev_.handle())
+            bev_.set(nullptr, nullptr, nullptr, nullptr);
+        wslay_.destroy();
+    }
+
+    void on_open(open_fn_type fn)
+    {
+        open_fn_ = std::move(fn);
+    }
+
+    void on_message(message_fn_type fn)
+    {
+        message_fn_ = std::move(fn);
+    }
+
+    void on_close(close_fn_type fn)
+    {
+        close_fn_ = std::move(fn);
+    }
+
+    void on_accept(accept_fn_type fn)
+    {
+        accept_fn_ = std::move(fn);
+    }
+
+    void set_max_message(std::uint64_t len) noexcept
+    {
+        max_message_ = len;
+    }
+
+    // предлагать (клиент) или принимать (сервер) permessage-deflate
+    // пул потоков zlib общий для соединений одного потока
+    void set(std::shared_ptr<zstream_pool> pool,
+        const deflate_params& params = deflate_params())
+    {
+        zpool_ = std::move(pool);
+        zparams_ = params;
+    }
+
+    // согласованное сжатие, nullptr - без сжатия
+    const permessage_deflate* get_deflate() const noexcept
+    {
+        return deflate_.get();
+    }
+
+    // клиент, upgrade уйдет после BEV_EVENT_CONNECTED
+    // так же работает с ssl::bevtls::connect
+    // protocol - список через запятую или пусто
+    void client(std::string host, std::string target = "/",
+        std::string protocol = std::string())
+    {
+        server_ = false;
+        host_ = std::move(host);
+        target_ = std::move(target);
+        protocol_ = std::move(protocol);
+        state_ = state::idle;
+        bev_.set(bevfn_type(*this));
+    }
+
+    void connect(dns_handle_t dns, const std::string& host, int port,
+        std::string target = "/", std::string protocol = std::string())
+    {
+        client(((port == 80) || (port == 443)) ?
+            host : host + ':' + std::to_string(port),
+            std::move(target), std::move(protocol));
+
+        bev_.enable(EV_READ|EV_WRITE);
+        bev_.connect(dns, host, port);
+    }
+
+    // запрос upgrade на уже подключенном bev
+    void upgrade()
+    {
+        using namespace std::literals;
+
+        key_ = handshake::make_key();
+
+        std::string req;
+        req.reserve(192 + host_.size() + target_.size() + protocol_.size());
+        req += "GET "sv;
+        req += target_;
+        req += " HTTP/1.1\r\nHost: "sv;
+        req += host_;
+        req += "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Version: 13\r\nSec-WebSocket-Key: "sv;
+        req += key_;
+        if (!protocol_.empty())
+        {
+            req += "\r\nSec-WebSocket-Protocol: "sv;
+            req += protocol_;
+        }
+        if (zpool_)
+        {
+            req += "\r\nSec-WebSocket-Extensions: "sv;
+            req += zparams_.to_string(true);
+        }
+        req += "\r\n\r\n"sv;
+
+        state_ = state::handshake;
+        send_head(req);
+        bev_.enable(EV_READ|EV_WRITE);
+    }
+
+    // сервер на принятом соединении, ждем запрос upgrade
+    void accept()
+    {
+        server_ = true;
+        state_ = state::handshake;
+        bev_.set(bevfn_type(*this));
+        bev_.enable(EV_READ|EV_WRITE);
+    }
+
+    void send_text(std::string_view text)
+    {
+        assert(state_ == state::open);
+        if (!queue_deflate(WSLAY_TEXT_FRAME, text))
+            wslay_.queue_text(text);
+        flush();
+    }
+
+    void send_binary(const void *data, std::size_t len)
+    {
+        assert(state_ == state::open);
+        if (!queue_deflate(WSLAY_BINARY_FRAME, std::string_view(
+            static_cast<const char*>(data), len)))
+        {
+            wslay_.queue_binary(data, len);
+        }
+        flush();
+    }
+
+    // кадр сразу в output, минуя очередь и копию wslay
+    // клиент маскирует payload при записи в output
+    // внутри on_message может обогнать то, что ушло через send_text
+    void send(std::uint8_t opcode, const void *data, std::size_t len)
+    {
+        assert(state_ == state::open);
+
+        flush();
+
+        if (deflate_ && deflate_->compress(std::string_view(
+            static_cast<const char*>(data), len), ztx_))
+        {
+            opcode |= frame_header::rsv1;
+            data = ztx_.data();
+            len = ztx_.size();
+        }
+
+        if (server_)
+            write_frame(bev_.output(), opcode, data, len);
+        else
+        {
+            std::uint8_t key[4];
+            mask_source::local()(key, sizeof(key));
+            write_frame(bev_.output(), opcode, data, len, key);
+        }
+    }
+
+    // рассылка одного кадра, только для сервера
+    // сжатый кадр только при server_no_context_takeover
+    void send(const shared_frame& frame)
+    {
+        assert(server_ && (state_ == state::open));
+
+        if (frame.compressed() && !(deflate_ && deflate_->stateless()))
+            throw std::logic_error("websocket shared frame compressed");
+
+        flush();
+        frame.append_to(bev_.output());
+    }
+
+    // после ответа сервера придет on_close
+    void close(std::uint16_t status = 1000,
+        std::string_view reason = std::string_view())
+    {
+        if (state_ != state::open)
+            return;
+
+        close_status_ = status;
+        wslay_.queue_close(static_cast<wslay_status_code>(status), reason);
+        flush();
+    }
+
+    state get_state() const noexcept
+    {
+        return state_;
+    }
+
+    // выбранный при upgrade протокол
+    const std::string& protocol() const noexcept
+    {
+        return protocol_;
+    }
+
+    // target запроса upgrade
+    const std::string& target() const noexcept
+    {
+        return target_;
+    }
+
+    // интерфейс для context
+    ssize_t wslay_receive(std::uint8_t *data, std::size_t len)
+    {
+        auto input = bev_.input();
+        if (input.empty())
+        {
+            wslay_event_set_error(wslay_, WSLAY_ERR_WOULDBLOCK);
+            return -1;
+        }
+
+        return static_cast<ssize_t>(input.remove(data, len));
+    }
+
+    void wslay_message(const wslay_event_on_msg_recv_arg *msg)
+    {
+        assert(msg);
+
+        switch (msg->opcode)
+        {
+        case WSLAY_TEXT_FRAME:
+        case WSLAY_BINARY_FRAME:
+        {
+            std::string_view data(reinterpret_cast<const char*>(msg->msg),
+                msg->msg_length);
+
+            // распаковываем всегда, иначе разойдется словарь
+            if (msg->rsv & WSLAY_RSV1_BIT)
+            {
+                assert(deflate_);
+                try
+                {
+                    deflate_->decompress(data, zrx_,
+                        static_cast<std::size_t>(max_message_));
+                }
+                catch (...)
+                {
+                    // 1007 - неверные данные сообщения
+                    wslay_.queue_close(static_cast<wslay_status_code>(1007),
+                        std::string_view());
+                    break;
+                }
+                data = zrx_;
+            }
+
+            if (message_fn_)
+                message_fn_(msg->opcode, data);
+            break;
+        }
+        case WSLAY_CONNECTION_CLOSE:
+            // ответный close wslay поставит в очередь сам
+            close_status_ = msg->status_code;
+            break;
+        default:;
+        }
+    }
+};
+
+} // namespace wslay
+} // namespace btpro
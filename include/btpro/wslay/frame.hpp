@@ -0,0 +1,331 @@
+#pragma once
+
+#include "btpro/buffer.hpp"
+#include "btpro/ssl/rand.hpp"
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace btpro {
+namespace wslay {
+
+// xor payload с ключом маски, dst может совпадать с src
+// offset - позиция src от начала payload, для продолжения кадра
+// ширина - avx2/sse2/neon по флагам сборки, хвост по 8 и по 1 байту
+static inline void mask_copy(std::uint8_t *dst, const std::uint8_t *src,
+    std::size_t len, const std::uint8_t *key, std::size_t offset = 0) noexcept
+{
+    assert(key);
+
+    // ключ повернутый так, чтобы src[i] шел с k[i & 3]
+    std::uint8_t k[8];
+    for (std::size_t i = 0; i < 8; ++i)
+        k[i] = key[(offset + i) & 3];
+
+    std::size_t i = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__ARM_NEON)
+    std::uint32_t k32;
+    std::memcpy(&k32, k, sizeof(k32));
+#endif
+
+#if defined(__AVX2__)
+    auto k256 = _mm256_set1_epi32(static_cast<int>(k32));
+    for (; i + 32 <= len; i += 32)
+    {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+            _mm256_xor_si256(v, k256));
+    }
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    auto k128 = _mm_set1_epi32(static_cast<int>(k32));
+    for (; i + 16 <= len; i += 16)
+    {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+            _mm_xor_si128(v, k128));
+    }
+#elif defined(__ARM_NEON)
+    auto k128 = vreinterpretq_u8_u32(vdupq_n_u32(k32));
+    for (; i + 16 <= len; i += 16)
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(src + i), k128));
+#endif
+
+    std::uint64_t k64;
+    std::memcpy(&k64, k, sizeof(k64));
+    for (; i + 8 <= len; i += 8)
+    {
+        std::uint64_t v;
+        std::memcpy(&v, src + i, sizeof(v));
+        v ^= k64;
+        std::memcpy(dst + i, &v, sizeof(v));
+    }
+
+    for (; i < len; ++i)
+        dst[i] = src[i] ^ k[i & 3];
+}
+
+static inline void mask(std::uint8_t *data, std::size_t len,
+    const std::uint8_t *key, std::size_t offset = 0) noexcept
+{
+    mask_copy(data, data, len, key, offset);
+}
+
+// ключи маски пачкой из RAND_bytes вместо вызова на каждый кадр
+class mask_source
+{
+    std::uint8_t buf_[256];
+    std::size_t pos_{sizeof(buf_)};
+
+public:
+    void operator()(std::uint8_t *out, std::size_t len)
+    {
+        assert(out);
+
+        while (len)
+        {
+            if (pos_ == sizeof(buf_))
+            {
+                ssl::rand rnd;
+                if (rnd(buf_, sizeof(buf_)) != 1)
+                    throw std::runtime_error("RAND_bytes");
+                pos_ = 0;
+            }
+
+            auto n = (std::min)(len, sizeof(buf_) - pos_);
+            std::memcpy(out, buf_ + pos_, n);
+            pos_ += n;
+            out += n;
+            len -= n;
+        }
+    }
+
+    // свой источник на поток
+    static mask_source& local()
+    {
+        static thread_local mask_source source;
+        return source;
+    }
+};
+
+// заголовок кадра rfc 6455
+struct frame_header
+{
+    constexpr static std::size_t max_size = 14;
+    // сжатый кадр permessage-deflate, передается вместе с opcode
+    constexpr static std::uint8_t rsv1 = 0x40;
+
+    bool fin{true};
+    // биты rsv1..rsv3 в позициях первого байта
+    std::uint8_t rsv{};
+    std::uint8_t opcode{};
+    bool masked{false};
+    std::uint8_t key[4]{};
+    std::uint64_t length{};
+
+    // возвращает число записанных байт
+    std::size_t write(std::uint8_t *out) const noexcept
+    {
+        assert(out);
+
+        std::size_t n = 0;
+        out[n++] = static_cast<std::uint8_t>((fin ? 0x80 : 0) |
+            (rsv & 0x70) | (opcode & 0x0f));
+
+        std::uint8_t m = masked ? 0x80 : 0;
+        if (length < 126)
+            out[n++] = m | static_cast<std::uint8_t>(length);
+        else if (length <= 0xffff)
+        {
+            out[n++] = m | 126;
+            out[n++] = static_cast<std::uint8_t>(length >> 8);
+            out[n++] = static_cast<std::uint8_t>(length);
+        }
+        else
+        {
+            out[n++] = m | 127;
+            for (int s = 56; s >= 0; s -= 8)
+                out[n++] = static_cast<std::uint8_t>(length >> s);
+        }
+
+        if (masked)
+        {
+            std::memcpy(out + n, key, sizeof(key));
+            n += sizeof(key);
+        }
+
+        return n;
+    }
+
+    // возвращает размер заголовка, 0 - данных пока мало
+    std::size_t parse(const std::uint8_t *data, std::size_t len)
+    {
+        assert(data);
+
+        if (len < 2)
+            return 0;
+
+        fin = (data[0] & 0x80) != 0;
+        rsv = data[0] & 0x70;
+        opcode = data[0] & 0x0f;
+        masked = (data[1] & 0x80) != 0;
+
+        std::size_t n = 2;
+        length = data[1] & 0x7f;
+        if (length == 126)
+        {
+            if (len < 4)
+                return 0;
+            length = (std::uint64_t{data[2]} << 8) | data[3];
+            n = 4;
+        }
+        else if (length == 127)
+        {
+            if (len < 10)
+                return 0;
+            length = 0;
+            for (std::size_t i = 2; i < 10; ++i)
+                length = (length << 8) | data[i];
+            if (length >> 63)
+                throw std::runtime_error("websocket frame length");
+            n = 10;
+        }
+
+        if (masked)
+        {
+            if (len < n + sizeof(key))
+                return 0;
+            std::memcpy(key, data + n, sizeof(key));
+            n += sizeof(key);
+        }
+
+        return n;
+    }
+};
+
+// кадр целиком в out, opcode | frame_header::rsv1 - сжатый
+// маскированный payload пишется xor-ом сразу в память out
+static inline void write_frame(buffer_ref out, std::uint8_t opcode,
+    const void *data, std::size_t len, const std::uint8_t *key = nullptr,
+    bool fin = true)
+{
+    frame_header hdr;
+    hdr.fin = fin;
+    hdr.rsv = opcode & 0x70;
+    hdr.opcode = opcode & 0x0f;
+    hdr.length = len;
+    if (key)
+    {
+        hdr.masked = true;
+        std::memcpy(hdr.key, key, sizeof(hdr.key));
+    }
+
+    std::uint8_t head[frame_header::max_size];
+    out.append(head, hdr.write(head));
+
+    if (!len)
+        return;
+
+    assert(data);
+    if (!key)
+    {
+        out.append(data, len);
+        return;
+    }
+
+    evbuffer_iovec vec[2];
+    auto count = evbuffer_reserve_space(out.handle(),
+        static_cast<ev_ssize_t>(len), vec, 2);
+    if (count < 1)
+        throw std::runtime_error("evbuffer_reserve_space");
+
+    auto src = static_cast<const std::uint8_t*>(data);
+    std::size_t pos = 0;
+    for (int i = 0; (i < count) && (pos < len); ++i)
+    {
+        auto n = (std::min)(vec[i].iov_len, len - pos);
+        mask_copy(static_cast<std::uint8_t*>(vec[i].iov_base),
+            src + pos, n, key, pos);
+        vec[i].iov_len = n;
+        pos += n;
+    }
+
+    if (evbuffer_commit_space(out.handle(), vec, count) == code::fail)
+        throw std::runtime_error("evbuffer_commit_space");
+}
+
+// большой payload по ссылке, без копирования
+// при маскировании data изменяется на месте
+// cleanup вызывается когда out больше не ссылается на data
+static inline void write_frame_ref(buffer_ref out, std::uint8_t opcode,
+    std::uint8_t *data, std::size_t len, evbuffer_ref_cleanup_cb cleanup,
+    void *arg, const std::uint8_t *key = nullptr, bool fin = true)
+{
+    assert(data && len);
+
+    frame_header hdr;
+    hdr.fin = fin;
+    hdr.rsv = opcode & 0x70;
+    hdr.opcode = opcode & 0x0f;
+    hdr.length = len;
+    if (key)
+    {
+        hdr.masked = true;
+        std::memcpy(hdr.key, key, sizeof(hdr.key));
+        mask(data, len, key);
+    }
+
+    std::uint8_t head[frame_header::max_size];
+    out.append(head, hdr.write(head));
+    out.append_ref(data, len, cleanup, arg);
+}
+
+// один немаскированный кадр для рассылки многим клиентам сервера
+// кодируется один раз, в каждый output попадает ссылка на те же блоки
+// opcode | frame_header::rsv1 - payload уже сжат permessage_deflate
+class shared_frame
+{
+    buffer data_{};
+    bool compressed_{false};
+
+public:
+    shared_frame() = default;
+
+    shared_frame(std::uint8_t opcode, const void *data, std::size_t len)
+        : compressed_((opcode & frame_header::rsv1) != 0)
+    {
+        write_frame(data_, opcode, data, len);
+    }
+
+    shared_frame(std::uint8_t opcode, std::string_view text)
+        : shared_frame(opcode, text.data(), text.size())
+    {   }
+
+    void append_to(buffer_ref out) const
+    {
+        detail::check_result("evbuffer_add_buffer_reference",
+            evbuffer_add_buffer_reference(out.handle(), data_.handle()));
+    }
+
+    std::size_t size() const noexcept
+    {
+        return data_.size();
+    }
+
+    bool compressed() const noexcept
+    {
+        return compressed_;
+    }
+};
+
+} // namespace wslay
+} // namespace btpro
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "btpro/ssl/rand.hpp"
+#include "btpro/ssl/sha.hpp"
+#include "btpro/ssl/base64.hpp"
+
+#include <string>
+#include <string_view>
+
+namespace btpro {
+namespace wslay {
+
+// http upgrade по rfc 6455
+// заголовок запроса или ответа разбирается без копирования
+class handshake
+{
+public:
+    // больше - это не websocket
+    constexpr static std::size_t max_head = 8192;
+
+    static char tolower(char c) noexcept
+    {
+        return ((c >= 'A') && (c <= 'Z')) ? static_cast<char>(c + 32) : c;
+    }
+
+    static bool iequal(std::string_view a, std::string_view b) noexcept
+    {
+        if (a.size() != b.size())
+            return false;
+
+        for (std::size_t i = 0; i < a.size(); ++i)
+        {
+            if (tolower(a[i]) != tolower(b[i]))
+                return false;
+        }
+
+        return true;
+    }
+
+    static std::string_view trim(std::string_view text) noexcept
+    {
+        while (!text.empty() && ((text.front() == ' ') || (text.front() == '\t')))
+            text.remove_prefix(1);
+        while (!text.empty() && ((text.back() == ' ') || (text.back() == '\t')))
+            text.remove_suffix(1);
+        return text;
+    }
+
+    // значение вида "keep-alive, Upgrade" содержит token
+    static bool has_token(std::string_view value, std::string_view token) noexcept
+    {
+        while (!value.empty())
+        {
+            auto f = value.find(',');
+            if (iequal(trim(value.substr(0, f)), token))
+                return true;
+            if (f == std::string_view::npos)
+                break;
+            value.remove_prefix(f + 1);
+        }
+        return false;
+    }
+
+    // случайный Sec-WebSocket-Key
+    static std::string make_key()
+    {
+        std::uint8_t buf[16];
+        ssl::rand rnd;
+        if (rnd(buf, sizeof(buf)) != 1)
+            throw std::runtime_error("RAND_bytes");
+
+        ssl::base64 b64;
+        return b64.encode(buf, sizeof(buf));
+    }
+
+    // Sec-WebSocket-Accept для ключа клиента
+    static std::string accept_key(std::string_view key)
+    {
+        using namespace std::literals;
+        constexpr auto uuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"sv;
+
+        std::string text;
+        text.reserve(key.size() + uuid.size());
+        text += key;
+        text += uuid;
+
+        ssl::sha1 sha1;
+        ssl::sha1::outbuf_type buf;
+        sha1(text, buf);
+
+        ssl::base64 b64;
+        return b64.encode(buf, sizeof(buf));
+    }
+
+    // head - все до пустой строки включительно
+    // fn(key, value) для каждого хидера, возвращает первую строку
+    // пустая строка - формат неверный
+    template<class F>
+    static std::string_view parse(std::string_view head, F fn)
+    {
+        auto f = head.find("\r\n");
+        if (f == std::string_view::npos)
+            return std::string_view();
+
+        auto first = head.substr(0, f);
+        head.remove_prefix(f + 2);
+
+        while (!head.empty())
+        {
+            f = head.find("\r\n");
+            if (f == std::string_view::npos)
+                return std::string_view();
+
+            auto line = head.substr(0, f);
+            head.remove_prefix(f + 2);
+            if (line.empty())
+                break;
+
+            auto c = line.find(':');
+            if ((c == std::string_view::npos) || !c)
+                return std::string_view();
+
+            fn(trim(line.substr(0, c)), trim(line.substr(c + 1)));
+        }
+
+        return first;
+    }
+
+    // "HTTP/1.1 101 Switching Protocols" -> 101, -1 при ошибке
+    static int status(std::string_view first) noexcept
+    {
+        auto f = first.find(' ');
+        if ((f == std::string_view::npos) || (first.size() < f + 4) ||
+            (first.substr(0, 5) != "HTTP/"))
+        {
+            return -1;
+        }
+
+        int rc = 0;
+        for (std::size_t i = f + 1; i < f + 4; ++i)
+        {
+            auto c = first[i];
+            if ((c < '0') || (c > '9'))
+                return -1;
+            rc = rc * 10 + (c - '0');
+        }
+        return rc;
+    }
+
+    // "GET /path HTTP/1.1" -> "/path", пусто если не GET
+    static std::string_view target(std::string_view first) noexcept
+    {
+        using namespace std::literals;
+        if (first.substr(0, 4) != "GET "sv)
+            return std::string_view();
+
+        first.remove_prefix(4);
+        auto f = first.find(' ');
+        if ((f == std::string_view::npos) ||
+            (first.substr(f + 1, 5) != "HTTP/"sv))
+        {
+            return std::string_view();
+        }
+
+        return first.substr(0, f);
+    }
+};
+
+} // namespace wslay
+} // namespace btpro